@@ -4,11 +4,24 @@
 
 #include "ff_headers.h"
 #include "ff_logging.h"
+#include "ff_metrics.h"
+#include "ff_mmap_io.h"
 
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace ff;
 
@@ -16,6 +29,11 @@ using namespace ff;
 #define ERROR -1
 
 constexpr uint32_t kDefaultPacketsNumToProcess = 20;
+constexpr int kDefaultThumbnailWidth = 320;
+constexpr int kMaxThumbnails = 1024;
+constexpr int kMaxThumbnailWidth = 4096;
+constexpr size_t kMaxContactSheetBytes = 256 << 20;
+constexpr int kMaxThreadCount = 1024;  // sanity bound of --jobs / --codec-threads
 
 const char *Str(AVMediaType codec) {
     switch (codec) {
@@ -28,6 +46,81 @@ const char *Str(AVMediaType codec) {
     }
 }
 
+struct Options {
+    bool use_mmap = false;  // demux through ff_mmap_io instead of the file protocol
+    int mmap_buffer_size = kDefaultMmapIOBufferSize;
+    int thumbnails = 0;  // > 0 switches to keyframe-only contact sheet extraction
+    int thumbnail_width = kDefaultThumbnailWidth;
+    const char *batch = nullptr;  // file list or directory processed on a worker pool
+    int jobs = 0;                 // files decoded concurrently, 0 balances against cores
+    int codec_threads = 0;        // libavcodec threads per file, 0 leaves it to the mode
+    const char *metrics = nullptr;  // per stage metrics file, .prom for prometheus text
+    int metrics_interval_ms = 0;    // also rewrite it periodically while running
+    std::vector<const char *> inputs;
+};
+
+// whole number >= 0, 0 being the "pick for me" value of the thread options
+bool parse_count(const char *value, int *count) {
+    char *end = nullptr;
+    auto n = std::strtol(value, &end, 10);
+    if (end == value || *end != '\0' || n < 0 || n > kMaxThreadCount) return false;
+    *count = static_cast<int>(n);
+    return true;
+}
+
+// [--mmap] [--mmap-buffer=<bytes>] [--thumbnails=<n>] [--thumbnail-width=<px>]
+// [--jobs=<n>] [--codec-threads=<n>] [--metrics=<file>] [--metrics-interval=<ms>]
+// (--batch=<list|dir> | file...)
+bool parse_options(int argc, const char *argv[], Options *options) {
+    for (auto i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (!std::strcmp(arg, "--mmap")) {
+            options->use_mmap = true;
+        } else if (!std::strncmp(arg, "--mmap-buffer=", 14)) {
+            options->use_mmap = true;
+            options->mmap_buffer_size = std::atoi(arg + 14);
+            if (options->mmap_buffer_size <= 0) {
+                LOGE("ff", "invalid mmap buffer size %s", arg + 14);
+                return false;
+            }
+        } else if (!std::strncmp(arg, "--thumbnails=", 13)) {
+            options->thumbnails = std::atoi(arg + 13);
+            if (options->thumbnails <= 0 || options->thumbnails > kMaxThumbnails) {
+                LOGE("ff", "invalid thumbnails number %s (1..%d)", arg + 13, kMaxThumbnails);
+                return false;
+            }
+        } else if (!std::strncmp(arg, "--thumbnail-width=", 18)) {
+            options->thumbnail_width = std::atoi(arg + 18);
+            if (options->thumbnail_width <= 0 || options->thumbnail_width > kMaxThumbnailWidth) {
+                LOGE("ff", "invalid thumbnail width %s (1..%d)", arg + 18, kMaxThumbnailWidth);
+                return false;
+            }
+        } else if (!std::strncmp(arg, "--batch=", 8)) {
+            options->batch = arg + 8;
+        } else if (!std::strncmp(arg, "--jobs=", 7)) {
+            if (!parse_count(arg + 7, &options->jobs)) {
+                LOGE("ff", "invalid jobs number %s", arg + 7);
+                return false;
+            }
+        } else if (!std::strncmp(arg, "--codec-threads=", 16)) {
+            if (!parse_count(arg + 16, &options->codec_threads)) {
+                LOGE("ff", "invalid codec threads number %s", arg + 16);
+                return false;
+            }
+        } else if (!std::strncmp(arg, "--metrics=", 10)) {
+            options->metrics = arg + 10;
+        } else if (!std::strncmp(arg, "--metrics-interval=", 19)) {
+            options->metrics_interval_ms = std::atoi(arg + 19);
+        } else if (!std::strncmp(arg, "--", 2)) {
+            LOGE("ff", "unknown option %s", arg);
+            return false;
+        } else {
+            options->inputs.push_back(arg);
+        }
+    }
+    return options->batch || !options->inputs.empty();
+}
+
 struct StreamCodecInfo {
     AVCodec *codec = nullptr;
     AVCodecParameters *params = nullptr;
@@ -35,9 +128,10 @@ struct StreamCodecInfo {
 };
 
 void save_gray_frame(uint8_t *buf, int stride, int width, int height, const char *filename) {
+    FF_METRIC_TIMER(kStageWriteFrame);
     std::fstream of(filename, std::ios::binary | std::ios::out);
     if (!of.is_open()) {
-        logging("ERROR: failed to open %s", filename);
+        LOGE("ff", "failed to open %s", filename);
         of.close();
         return;
     }
@@ -53,14 +147,16 @@ void save_gray_frame(uint8_t *buf, int stride, int width, int height, const char
         const char *head = reinterpret_cast<const char *>(buf + i * stride);
         of.write(head, width);
     }
+    FF_METRIC_BYTES(kStageWriteFrame, 0, width * height);
 
     of.close();
 }
 
 void save_pcm_data(uint8_t **buf, int buf_size, int samples, int channels, const char *filename) {
+    FF_METRIC_TIMER(kStageWriteFrame);
     std::fstream of(filename, std::ios::binary | std::ios::out);
     if (!of.is_open()) {
-        logging("ERROR: failed to open %s", filename);
+        LOGE("ff", "failed to open %s", filename);
         of.close();
         return;
     }
@@ -71,52 +167,71 @@ void save_pcm_data(uint8_t **buf, int buf_size, int samples, int channels, const
             of.write(head, buf_size);
         }
     }
+    FF_METRIC_BYTES(kStageWriteFrame, 0, buf_size * samples * channels);
 
     of.close();
 }
 
-int decode_packet(AVPacket *packet, AVCodecContext *context, AVFrame *frame, bool is_audio) {
+// av_read_frame, accounted as the demux stage
+int timed_read_frame(AVFormatContext *context, AVPacket *packet) {
+    FF_METRIC_TIMER(kStageDemux);
+    auto ret = av_read_frame(context, packet);
+    if (ret >= 0) FF_METRIC_BYTES(kStageDemux, 0, packet->size);
+    return ret;
+}
+
+int decode_packet(AVPacket *packet, AVCodecContext *context, AVFrame *frame, bool is_audio,
+                  const std::string &prefix) {
     // raw packet data
-    auto response = avcodec_send_packet(context, packet);
+    int response;
+    {
+        FF_METRIC_TIMER(kStageSendPacket);
+        response = avcodec_send_packet(context, packet);
+    }
+    FF_METRIC_BYTES(kStageSendPacket, packet->size, 0);
     if (response < 0) {
-        logging("ERROR: in sending packet to codec (%s)", av_err2str(response));
+        LOGE("ff", "in sending packet to codec (%s)", av_err2str(response));
         return response;
     }
     while (response >= 0) {
         // decoded frame data
-        response = avcodec_receive_frame(context, frame);
+        {
+            FF_METRIC_TIMER(kStageReceiveFrame);
+            response = avcodec_receive_frame(context, frame);
+        }
         if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
             // logging("EOF");
             break;
         } else if (response < 0) {
-            logging("ERROR: in receiving frame from codec (%s)", av_err2str(response));
+            LOGE("ff", "in receiving frame from codec (%s)", av_err2str(response));
             return response;
         }
 
         if (response >= 0) {
             if (is_audio) {
-                logging(
-                    "\tA: Frame %d (channels=%d samples=%d, sample_rate=%d, size=%d bytes) pts %d "
-                    "[DTS %d]",
-                    context->frame_number, context->channels, frame->nb_samples, frame->sample_rate,
-                    frame->pkt_size, frame->pts, frame->pkt_dts);
+                LOGD("decode",
+                     "\tA: Frame %d (channels=%d samples=%d, sample_rate=%d, size=%d bytes) pts "
+                     "%" PRId64 " [DTS %" PRId64 "]",
+                     context->frame_number, context->channels, frame->nb_samples,
+                     frame->sample_rate, frame->pkt_size, frame->pts, frame->pkt_dts);
                 auto data_size = av_get_bytes_per_sample(context->sample_fmt);
                 if (data_size < 0) {
                     /* This should not occur, checking just for paranoia */
-                    logging("ERROR: failed to calculate data size");
+                    LOGE("ff", "failed to calculate data size");
                     return ERROR;
                 }
-                std::string out_filename{"audio_frame-"};
+                std::string out_filename{prefix + "audio_frame-"};
                 out_filename += std::to_string(context->frame_number) + ".pcm";
                 save_pcm_data(frame->data, data_size, frame->nb_samples, context->channels,
                               out_filename.c_str());
             } else {
-                logging(
-                    "\tV: Frame %d (type=%c, size=%d bytes) pts %d key_frame %d [DTS %d(order)]",
-                    context->frame_number, av_get_picture_type_char(frame->pict_type),
-                    frame->pkt_size, frame->pts, frame->key_frame, frame->coded_picture_number);
+                LOGD("decode",
+                     "\tV: Frame %d (type=%c, size=%d bytes) pts %" PRId64
+                     " key_frame %d [DTS %d(order)]",
+                     context->frame_number, av_get_picture_type_char(frame->pict_type),
+                     frame->pkt_size, frame->pts, frame->key_frame, frame->coded_picture_number);
 
-                std::string out_filename{"video_frame-"};
+                std::string out_filename{prefix + "video_frame-"};
                 out_filename += std::to_string(context->frame_number) + ".pgm";
                 // logging("saving %s", out_filename.c_str());
                 save_gray_frame(frame->data[0], frame->linesize[0], frame->width, frame->height,
@@ -129,62 +244,82 @@ int decode_packet(AVPacket *packet, AVCodecContext *context, AVFrame *frame, boo
 }
 
 int decodeAVStreams(StreamCodecInfo *video_stream, StreamCodecInfo *audio_stream,
-                    AVFormatContext *context) {
+                    AVFormatContext *context, int codecThreads, const std::string &prefix) {
     logging("decoding a/v streams");
-    AVCodecContext *pVideoCodecContext = avcodec_alloc_context3(video_stream->codec);
-    AVCodecContext *pAudioCodecContext = avcodec_alloc_context3(audio_stream->codec);
-    if (!pVideoCodecContext || !pAudioCodecContext) {
-        logging("ERROR: failed to allocate codec context");
-        return ERROR;
+    AVCodecContext *pVideoCodecContext = nullptr;
+    AVCodecContext *pAudioCodecContext = nullptr;
+    AVFrame *pFrame = nullptr;
+    AVPacket *pPacket = nullptr;
+    // batch jobs keep going after a bad file, so nothing may leak on the error paths
+    auto release = [&](int ret) {
+        av_packet_free(&pPacket);
+        av_frame_free(&pFrame);
+        avcodec_free_context(&pVideoCodecContext);
+        avcodec_free_context(&pAudioCodecContext);
+        return ret;
+    };
+
+    pVideoCodecContext = avcodec_alloc_context3(video_stream->codec);
+    // audio is optional, plenty of clips come without it
+    if (audio_stream->id >= 0) pAudioCodecContext = avcodec_alloc_context3(audio_stream->codec);
+    if (!pVideoCodecContext || (audio_stream->id >= 0 && !pAudioCodecContext)) {
+        LOGE("ff", "failed to allocate codec context");
+        return release(ERROR);
     }
 
     if (avcodec_parameters_to_context(pVideoCodecContext, video_stream->params) < 0) {
-        logging("ERROR: failed to copy video codec params");
-        return ERROR;
+        LOGE("ff", "failed to copy video codec params");
+        return release(ERROR);
     }
-    if (avcodec_parameters_to_context(pAudioCodecContext, audio_stream->params) < 0) {
-        logging("ERROR: failed to copy audio codec params");
-        return ERROR;
+    if (pAudioCodecContext &&
+        avcodec_parameters_to_context(pAudioCodecContext, audio_stream->params) < 0) {
+        LOGE("ff", "failed to copy audio codec params");
+        return release(ERROR);
+    }
+
+    if (codecThreads > 0) {
+        pVideoCodecContext->thread_count = codecThreads;
+        if (pAudioCodecContext) pAudioCodecContext->thread_count = codecThreads;
     }
 
     if (avcodec_open2(pVideoCodecContext, video_stream->codec, NULL) < 0) {
-        logging("ERROR: failed to open video codec through avcodec_open2");
-        return ERROR;
+        LOGE("ff", "failed to open video codec through avcodec_open2");
+        return release(ERROR);
     }
-    if (avcodec_open2(pAudioCodecContext, audio_stream->codec, NULL) < 0) {
-        logging("ERROR: failed to open video codec through avcodec_open2");
-        return ERROR;
+    if (pAudioCodecContext && avcodec_open2(pAudioCodecContext, audio_stream->codec, NULL) < 0) {
+        LOGE("ff", "failed to open video codec through avcodec_open2");
+        return release(ERROR);
     }
 
-    AVFrame *pFrame = av_frame_alloc();
+    pFrame = av_frame_alloc();
     if (!pFrame) {
-        logging("ERROR: failed to allocate frame");
-        return ERROR;
+        LOGE("ff", "failed to allocate frame");
+        return release(ERROR);
     }
-    AVPacket *pPacket = av_packet_alloc();
+    pPacket = av_packet_alloc();
     if (!pPacket) {
-        logging("ERROR: failed to allocate packet for");
-        return ERROR;
+        LOGE("ff", "failed to allocate packet for");
+        return release(ERROR);
     }
 
     int response = 0;
     auto nPackets = kDefaultPacketsNumToProcess;
-    while (av_read_frame(context, pPacket) >= 0) {
+    while (timed_read_frame(context, pPacket) >= 0) {
         // if it's the video stream
         if (pPacket->stream_index == video_stream->id) {
-            logging("video stream");
-            logging("\tAVPacket->pts %" PRId64, pPacket->pts);
-            response = decode_packet(pPacket, pVideoCodecContext, pFrame, false);
+            LOGT("demux", "video stream");
+            LOGT("demux", "\tAVPacket->pts %" PRId64, pPacket->pts);
+            response = decode_packet(pPacket, pVideoCodecContext, pFrame, false, prefix);
             if (response < 0) break;
             // stop it, otherwise we'll be saving hundreds of frames
         } else if (pPacket->stream_index == audio_stream->id) {
-            logging("autio stream");
-            logging("\tAVPacket->pts %" PRId64, pPacket->pts);
-            response = decode_packet(pPacket, pAudioCodecContext, pFrame, true);
+            LOGT("demux", "autio stream");
+            LOGT("demux", "\tAVPacket->pts %" PRId64, pPacket->pts);
+            response = decode_packet(pPacket, pAudioCodecContext, pFrame, true, prefix);
             if (response < 0) break;
             // stop it, otherwise we'll be saving hundreds of frames
         } else {
-            logging("unknown stream");
+            LOGT("demux", "unknown stream");
         }
         if (--nPackets <= 0) break;
         av_packet_unref(pPacket);
@@ -192,106 +327,383 @@ int decodeAVStreams(StreamCodecInfo *video_stream, StreamCodecInfo *audio_stream
 
     // logging("exiting %s", __func__);
 
-    av_packet_free(&pPacket);
-    av_frame_free(&pFrame);
-    avcodec_free_context(&pVideoCodecContext);
-    avcodec_free_context(&pAudioCodecContext);
-    return OK;
+    return release(response < 0 ? response : OK);
 }
 
-int main(int argc, const char *argv[]) {
-    if (argc < 2) {
-        printf("please specify an media file\n");
+// seek to `nThumbnails` evenly spaced timestamps, decode only the keyframe each seek lands on
+// (non-key frames and the loop filter are skipped) and tile their downscaled luma into a single
+// gray contact sheet
+int extract_thumbnails(StreamCodecInfo *video_stream, AVFormatContext *context, int nThumbnails,
+                       int thumbWidth, int codecThreads, const char *filename) {
+    if (video_stream->id < 0) {
+        LOGE("ff", "no video stream to extract thumbnails from");
         return ERROR;
     }
+    logging("extracting %d thumbnails", nThumbnails);
+    auto *stream = context->streams[video_stream->id];
 
-    logging("initializing");
+    // seek targets are spread over the duration, without one they would be garbage
+    if (context->duration == AV_NOPTS_VALUE && stream->duration == AV_NOPTS_VALUE) {
+        LOGE("ff", "unknown duration, cannot place thumbnails");
+        return ERROR;
+    }
+    // 16 aligned tiles keep every row that swscale writes into the sheet aligned
+    thumbWidth = (thumbWidth + 15) & ~15;
+    auto *params = video_stream->params;
+    if (params->width <= 0 || params->height <= 0) {
+        LOGE("ff", "invalid video size %d x %d", params->width, params->height);
+        return ERROR;
+    }
+    auto scaledHeight = (static_cast<int64_t>(params->height) * thumbWidth / params->width) & ~1;
+    if (scaledHeight <= 0) {
+        LOGE("ff", "%d x %d is too wide for %d px thumbnails", params->width, params->height,
+             thumbWidth);
+        return ERROR;
+    }
+    auto cols = static_cast<int>(std::ceil(std::sqrt(nThumbnails)));
+    auto rows = (nThumbnails + cols - 1) / cols;
+    auto sheetWidth = cols * thumbWidth;
+    // counts and widths are capped while parsing, a very tall input can still blow the sheet up
+    auto sheetBytes = static_cast<size_t>(sheetWidth) * rows * static_cast<size_t>(scaledHeight);
+    if (sheetBytes > kMaxContactSheetBytes) {
+        LOGE("ff", "%d x %d contact sheet of %d x %" PRId64 " px tiles is too large", cols, rows,
+             thumbWidth, scaledHeight);
+        return ERROR;
+    }
+    auto thumbHeight = static_cast<int>(scaledHeight);
 
-    AVFormatContext *pFormatContext = avformat_alloc_context();
-    if (!pFormatContext) {
-        logging("ERROR: failed to allocate memory for format context");
+    // only video keyframes are needed, let the demuxer drop everything else
+    for (auto i = 0; i < context->nb_streams; ++i) {
+        if (i != video_stream->id) context->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    AVCodecContext *pCodecContext = avcodec_alloc_context3(video_stream->codec);
+    if (!pCodecContext) {
+        LOGE("ff", "failed to allocate codec context");
+        return ERROR;
+    }
+    if (avcodec_parameters_to_context(pCodecContext, video_stream->params) < 0) {
+        LOGE("ff", "failed to copy video codec params");
+        avcodec_free_context(&pCodecContext);
+        return ERROR;
+    }
+    pCodecContext->skip_frame = AVDISCARD_NONKEY;
+    pCodecContext->skip_loop_filter = AVDISCARD_ALL;
+    if (codecThreads > 0) pCodecContext->thread_count = codecThreads;
+    if (avcodec_open2(pCodecContext, video_stream->codec, NULL) < 0) {
+        LOGE("ff", "failed to open video codec through avcodec_open2");
+        avcodec_free_context(&pCodecContext);
         return ERROR;
     }
 
-    for (auto i = 1; i < argc; ++i) {
-        const char *filename = argv[i];
-        logging("opening the %dst input file (%s) and loading format (container) header", i,
-                filename);
-
-        // open file and read its header
-        auto ret = avformat_open_input(&pFormatContext, filename, NULL, NULL);
-        if (ret != OK) {
-            logging("ERROR: failed to open input file (%d)", ret);
-            return ret;
+    std::vector<uint8_t> sheet(sheetBytes, 0);
+
+    AVFrame *pFrame = av_frame_alloc();
+    AVPacket *pPacket = av_packet_alloc();
+    SwsContext *pSwsContext = nullptr;
+    if (!pFrame || !pPacket) {
+        LOGE("ff", "failed to allocate frame or packet");
+        av_frame_free(&pFrame);
+        av_packet_free(&pPacket);
+        avcodec_free_context(&pCodecContext);
+        return ERROR;
+    }
+
+    auto duration = context->duration != AV_NOPTS_VALUE
+                        ? context->duration
+                        : av_rescale_q(stream->duration, stream->time_base, AV_TIME_BASE_Q);
+    auto startTime = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+
+    auto start = std::chrono::steady_clock::now();
+    int nDecoded = 0;
+    // pts of the last decoded keyframe, dts or file position when the packet has no pts
+    int64_t lastKey = 0;
+    bool haveLastKey = false;
+    for (auto n = 0; n < nThumbnails; ++n) {
+        // middle of the n-th of nThumbnails equal slices of the duration
+        auto target = startTime + av_rescale_q(duration * (2 * n + 1) / (2 * nThumbnails),
+                                               AV_TIME_BASE_Q, stream->time_base);
+        // uses the container's keyframe index when it has one (e.g. mp4 stss)
+        if (av_seek_frame(context, video_stream->id, target, AVSEEK_FLAG_BACKWARD) < 0) {
+            LOGW("ff", "failed to seek to %" PRId64, target);
+            continue;
         }
+        avcodec_flush_buffers(pCodecContext);
 
-        logging("format %s, duration %lld us, bit_rate %lld", pFormatContext->iformat->name,
-                pFormatContext->duration, pFormatContext->bit_rate);
+        int response;
+        while ((response = timed_read_frame(context, pPacket)) >= 0) {
+            if (pPacket->stream_index == video_stream->id && (pPacket->flags & AV_PKT_FLAG_KEY)) {
+                break;
+            }
+            av_packet_unref(pPacket);
+        }
+        if (response < 0) break;
+        // with sparse keyframes several targets land on the same one
+        auto key = pPacket->pts != AV_NOPTS_VALUE ? pPacket->pts : pPacket->dts;
+        auto keyKnown = key != AV_NOPTS_VALUE || pPacket->pos >= 0;
+        if (key == AV_NOPTS_VALUE) key = pPacket->pos;
+        if (keyKnown && haveLastKey && key == lastKey) {
+            av_packet_unref(pPacket);
+            continue;
+        }
+        // a keyframe without any of them can't be told apart, it always gets decoded
+        lastKey = key;
+        haveLastKey = keyKnown;
 
-        logging("finding stream info from format");
-        // read packet from format to get stream info
-        ret = avformat_find_stream_info(pFormatContext, NULL);
-        if (ret != OK) {
-            logging("ERROR: failed to read packet info (%d)", ret);
+        // drain right after the keyframe instead of feeding the rest of its GOP
+        response = avcodec_send_packet(pCodecContext, pPacket);
+        av_packet_unref(pPacket);
+        if (response >= 0) response = avcodec_send_packet(pCodecContext, NULL);
+        if (response >= 0) response = avcodec_receive_frame(pCodecContext, pFrame);
+        if (response < 0) {
+            LOGW("ff", "failed to decode keyframe %" PRId64 " (%s)", lastKey,
+                 av_err2str(response));
+            continue;
         }
 
-        AVCodec *pVideoCodec = nullptr;
-        AVCodec *pAudioCodec = nullptr;
-        AVCodecParameters *pVideoCodecParams = nullptr;
-        AVCodecParameters *pAudioCodecParams = nullptr;
-        int video_stream_id = -1;
-        int audio_stream_id = -1;
-
-        // iterate streams and select audio/video stream
-        for (auto stream_id = 0; stream_id < pFormatContext->nb_streams; ++stream_id) {
-            auto *pLocalCodecParams = pFormatContext->streams[stream_id]->codecpar;
-            logging("AVStream->time_base before open coded %d/%d",
-                    pFormatContext->streams[i]->time_base.num,
-                    pFormatContext->streams[i]->time_base.den);
-            logging("AVStream->r_frame_rate before open coded %d/%d",
-                    pFormatContext->streams[i]->r_frame_rate.num,
-                    pFormatContext->streams[i]->r_frame_rate.den);
-            logging("AVStream->start_time %" PRId64, pFormatContext->streams[i]->start_time);
-            logging("AVStream->duration %" PRId64, pFormatContext->streams[i]->duration);
-
-            logging("finding the proper decoder (CODEC)");
-            auto *pLocalCodec = avcodec_find_decoder(pLocalCodecParams->codec_id);
-            if (!pLocalCodec) {
-                logging("ERROR: unsupported codec of stream %d", stream_id);
-                continue;
+        if (!pSwsContext) {
+            pSwsContext = sws_getContext(pFrame->width, pFrame->height,
+                                         static_cast<AVPixelFormat>(pFrame->format), thumbWidth,
+                                         thumbHeight, AV_PIX_FMT_GRAY8, SWS_FAST_BILINEAR,
+                                         nullptr, nullptr, nullptr);
+            if (!pSwsContext) {
+                LOGE("ff", "failed to create scaling context");
+                break;
             }
+        }
+        // scale straight into the tile, the sheet is the only output buffer
+        uint8_t *tile[4] = {sheet.data() + (nDecoded / cols) * thumbHeight * sheetWidth +
+                                (nDecoded % cols) * thumbWidth,
+                            nullptr, nullptr, nullptr};
+        int tileLinesize[4] = {sheetWidth, 0, 0, 0};
+        sws_scale(pSwsContext, pFrame->data, pFrame->linesize, 0, pFrame->height, tile,
+                  tileLinesize);
+        av_frame_unref(pFrame);
+        ++nDecoded;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    logging("decoded %d keyframes in %.3f s", nDecoded, elapsed.count());
 
-            if (pLocalCodecParams->codec_type == AVMEDIA_TYPE_VIDEO) {
-                if (video_stream_id == -1) {
-                    video_stream_id = stream_id;
-                    pVideoCodec = pLocalCodec;
-                    pVideoCodecParams = pLocalCodecParams;
-                }
-                logging("Video Codec: stream %d, resolution %d x %d", stream_id,
-                        pLocalCodecParams->width, pLocalCodecParams->height);
-            } else if (pLocalCodecParams->codec_type == AVMEDIA_TYPE_AUDIO) {
-                if (audio_stream_id == -1) {
-                    audio_stream_id = stream_id;
-                    pAudioCodec = pLocalCodec;
-                    pAudioCodecParams = pLocalCodecParams;
-                }
-                logging("Audio Codec: stream %d, %d channels, sample rate %d", stream_id,
-                        pLocalCodecParams->channels, pLocalCodecParams->sample_rate);
+    auto usedRows = (nDecoded + cols - 1) / cols;
+    if (nDecoded > 0) {
+        logging("saving %s (%d x %d)", filename, sheetWidth, usedRows * thumbHeight);
+        save_gray_frame(sheet.data(), sheetWidth, sheetWidth, usedRows * thumbHeight, filename);
+    }
+
+    sws_freeContext(pSwsContext);
+    av_packet_free(&pPacket);
+    av_frame_free(&pFrame);
+    avcodec_free_context(&pCodecContext);
+    return nDecoded > 0 ? OK : ERROR;
+}
+
+// open, probe and decode (or extract thumbnails from) a single input. every call owns its
+// contexts, so calls for different files can run concurrently
+int process_file(const char *filename, int index, const Options &options, int codecThreads,
+                 const std::string &prefix) {
+    logging("opening the %dst input file (%s) and loading format (container) header", index,
+            filename);
+
+    // open file and read its header
+    AVFormatContext *pFormatContext = nullptr;
+    auto ret = options.use_mmap
+                   ? mmap_open_input(&pFormatContext, filename, options.mmap_buffer_size)
+                   : avformat_open_input(&pFormatContext, filename, NULL, NULL);
+    if (ret != OK) {
+        LOGE("ff", "failed to open input file (%d)", ret);
+        return ret;
+    }
+
+    logging("format %s, duration %lld us, bit_rate %lld", pFormatContext->iformat->name,
+            pFormatContext->duration, pFormatContext->bit_rate);
+
+    logging("finding stream info from format");
+    // read packet from format to get stream info
+    ret = avformat_find_stream_info(pFormatContext, NULL);
+    if (ret != OK) {
+        LOGW("ff", "failed to read packet info (%d)", ret);
+    }
+
+    AVCodec *pVideoCodec = nullptr;
+    AVCodec *pAudioCodec = nullptr;
+    AVCodecParameters *pVideoCodecParams = nullptr;
+    AVCodecParameters *pAudioCodecParams = nullptr;
+    int video_stream_id = -1;
+    int audio_stream_id = -1;
+
+    // iterate streams and select audio/video stream
+    for (auto stream_id = 0; stream_id < pFormatContext->nb_streams; ++stream_id) {
+        auto *pLocalCodecParams = pFormatContext->streams[stream_id]->codecpar;
+        logging("AVStream->time_base before open coded %d/%d",
+                pFormatContext->streams[stream_id]->time_base.num,
+                pFormatContext->streams[stream_id]->time_base.den);
+        logging("AVStream->r_frame_rate before open coded %d/%d",
+                pFormatContext->streams[stream_id]->r_frame_rate.num,
+                pFormatContext->streams[stream_id]->r_frame_rate.den);
+        logging("AVStream->start_time %" PRId64, pFormatContext->streams[stream_id]->start_time);
+        logging("AVStream->duration %" PRId64, pFormatContext->streams[stream_id]->duration);
+
+        logging("finding the proper decoder (CODEC)");
+        auto *pLocalCodec = avcodec_find_decoder(pLocalCodecParams->codec_id);
+        if (!pLocalCodec) {
+            LOGW("ff", "unsupported codec of stream %d", stream_id);
+            continue;
+        }
+
+        if (pLocalCodecParams->codec_type == AVMEDIA_TYPE_VIDEO) {
+            if (video_stream_id == -1) {
+                video_stream_id = stream_id;
+                pVideoCodec = pLocalCodec;
+                pVideoCodecParams = pLocalCodecParams;
             }
-            logging("\tCodec %s ID %d bit_rate %lld", pLocalCodec->name, pLocalCodec->id,
-                    pLocalCodecParams->bit_rate);
+            logging("Video Codec: stream %d, resolution %d x %d", stream_id,
+                    pLocalCodecParams->width, pLocalCodecParams->height);
+        } else if (pLocalCodecParams->codec_type == AVMEDIA_TYPE_AUDIO) {
+            if (audio_stream_id == -1) {
+                audio_stream_id = stream_id;
+                pAudioCodec = pLocalCodec;
+                pAudioCodecParams = pLocalCodecParams;
+            }
+            logging("Audio Codec: stream %d, %d channels, sample rate %d", stream_id,
+                    pLocalCodecParams->channels, pLocalCodecParams->sample_rate);
         }
+        logging("\tCodec %s ID %d bit_rate %lld", pLocalCodec->name, pLocalCodec->id,
+                pLocalCodecParams->bit_rate);
+    }
 
-        StreamCodecInfo video_stream{pVideoCodec, pVideoCodecParams, video_stream_id};
-        StreamCodecInfo audio_stream{pAudioCodec, pAudioCodecParams, audio_stream_id};
+    StreamCodecInfo video_stream{pVideoCodec, pVideoCodecParams, video_stream_id};
+    StreamCodecInfo audio_stream{pAudioCodec, pAudioCodecParams, audio_stream_id};
 
-        if (decodeAVStreams(&video_stream, &audio_stream, pFormatContext) != OK) {
-            logging("ERROR: failed to decode a/v streams");
-            return ERROR;
+    if (video_stream_id < 0) {
+        LOGE("ff", "no decodable video stream in %s", filename);
+        mmap_close_input(&pFormatContext);
+        return ERROR;
+    }
+
+    if (options.thumbnails > 0) {
+        std::string out_filename{"contact_sheet-"};
+        out_filename += std::to_string(index) + ".pgm";
+        ret = extract_thumbnails(&video_stream, pFormatContext, options.thumbnails,
+                                 options.thumbnail_width, codecThreads, out_filename.c_str());
+        if (ret != OK) LOGE("ff", "failed to extract thumbnails");
+    } else {
+        ret = decodeAVStreams(&video_stream, &audio_stream, pFormatContext, codecThreads, prefix);
+        if (ret != OK) LOGE("ff", "failed to decode a/v streams");
+    }
+
+    mmap_close_input(&pFormatContext);
+    if (ret != OK) return ret;
+    logging("OK: process (%s) done!", filename);
+    return OK;
+}
+
+// `path` is either a directory (its regular files, sorted) or a text file with one input per line
+bool collect_batch_inputs(const char *path, std::vector<std::string> *files) {
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        LOGE("ff", "failed to stat batch input %s", path);
+        return false;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        auto *dir = opendir(path);
+        if (!dir) {
+            LOGE("ff", "failed to open directory %s", path);
+            return false;
+        }
+        while (auto *entry = readdir(dir)) {
+            std::string file = std::string{path} + "/" + entry->d_name;
+            if (entry->d_name[0] != '.' && stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                files->push_back(file);
+            }
         }
+        closedir(dir);
+        std::sort(files->begin(), files->end());
+    } else {
+        std::ifstream list(path);
+        if (!list.is_open()) {
+            LOGE("ff", "failed to open file list %s", path);
+            return false;
+        }
+        std::string line;
+        while (std::getline(list, line)) {
+            if (!line.empty()) files->push_back(line);
+        }
+    }
+    return true;
+}
 
-        avformat_close_input(&pFormatContext);
-        logging("OK: process (%s) done!", filename);
+struct BatchResult {
+    int status = OK;
+    double seconds = 0;
+};
+
+int run_batch(const Options &options) {
+    std::vector<std::string> files;
+    if (!collect_batch_inputs(options.batch, &files)) return ERROR;
+    if (files.empty()) {
+        LOGE("ff", "no input in batch %s", options.batch);
+        return ERROR;
     }
-    avformat_free_context(pFormatContext);
-}
\ No newline at end of file
+
+    // small clips scale best across files, so by default every core gets its own file and a
+    // single codec thread. codec threads only get the cores left over when files run out
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    int jobs = options.jobs > 0 ? options.jobs : std::min<int>(cores, files.size());
+    int codecThreads =
+        options.codec_threads > 0 ? options.codec_threads : std::max(1, cores / jobs);
+    logging("batch: %zu files, %d jobs x %d codec threads (%d cores)", files.size(), jobs,
+            codecThreads, cores);
+
+    std::vector<BatchResult> results(files.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (auto i = next++; i < files.size(); i = next++) {
+            auto start = std::chrono::steady_clock::now();
+            // per file prefix, concurrent jobs must not overwrite each other's frames
+            results[i].status = process_file(files[i].c_str(), i + 1, options, codecThreads,
+                                             std::to_string(i + 1) + "-");
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            results[i].seconds = elapsed.count();
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (auto i = 0; i < jobs; ++i) pool.emplace_back(worker);
+    for (auto &thread : pool) thread.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    int nFailed = 0;
+    for (auto i = 0; i < files.size(); ++i) {
+        if (results[i].status == OK) continue;
+        ++nFailed;
+        LOGE("ff", "FAILED: [%d] %s (%d) after %.3f s", i + 1, files[i].c_str(),
+             results[i].status, results[i].seconds);
+    }
+    // with failures the summary is a warning, so it survives FF_LOG=warn next to them
+    FF_LOG(nFailed > 0 ? kLogWarn : kLogInfo, "ff",
+           "batch done: %zu files, %zu ok, %d failed in %.3f s, %.1f files/s", files.size(),
+           files.size() - nFailed, nFailed, elapsed.count(), files.size() / elapsed.count());
+    return nFailed == 0 ? OK : ERROR;
+}
+
+int main(int argc, const char *argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        printf("please specify an media file\n");
+        return ERROR;
+    }
+
+    logging("initializing");
+    if (options.metrics) metrics_export_at_exit(options.metrics, options.metrics_interval_ms);
+
+    if (options.batch) return run_batch(options);
+
+    for (auto i = 0; i < options.inputs.size(); ++i) {
+        if (process_file(options.inputs[i], i + 1, options, options.codec_threads, "") != OK) {
+            return ERROR;
+        }
+    }
+    return OK;
+}
@@ -4,13 +4,43 @@
 
 #include "ff_headers.h"
 #include "ff_logging.h"
+#include "ff_mmap_io.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace ff;
+
+#define OK 0
+#define ERROR -1
 
 int main(int argc, const char *argv[]) {
+    // [--mmap] [--mmap-buffer=<bytes>] input output [fragmented]
+    bool useMmap = false;
+    int mmapBufferSize = kDefaultMmapIOBufferSize;
+    std::vector<const char *> args;
+    for (auto i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--mmap")) {
+            useMmap = true;
+        } else if (!std::strncmp(argv[i], "--mmap-buffer=", 14)) {
+            useMmap = true;
+            mmapBufferSize = std::atoi(argv[i] + 14);
+            if (mmapBufferSize <= 0) {
+                LOGE("ff", "invalid mmap buffer size %s", argv[i] + 14);
+                return ERROR;
+            }
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+
     bool fragmentedMp4 = false;
-    if (argc < 3) {
+    if (args.size() < 2) {
         logging("please provide at least two params\n");
         return ERROR;
-    } else if (argc == 4) {
+    } else if (args.size() == 3) {
         logging("fragmented mp4");
         fragmentedMp4 = true;
     }
@@ -18,9 +48,45 @@ int main(int argc, const char *argv[]) {
     logging("initializing");
 
     AVFormatContext *inputFormatCtx = nullptr, *outputFormatCtx = nullptr;
-    AVPacket packet;
-    const char *inputFilename = argv[1], *outputFilename = argv[2];
+    AVPacket *packet = nullptr;
+    const char *inputFilename = args[0], *outputFilename = args[1];
     int ret;
     int streamId = 0, nStreams = 0;
     int *streamList = nullptr;
-}
\ No newline at end of file
+
+    ret = useMmap ? mmap_open_input(&inputFormatCtx, inputFilename, mmapBufferSize)
+                  : avformat_open_input(&inputFormatCtx, inputFilename, NULL, NULL);
+    if (ret < 0) {
+        LOGE("ff", "failed to open input file %s (%s)", inputFilename, av_err2str(ret));
+        return ERROR;
+    }
+    if ((ret = avformat_find_stream_info(inputFormatCtx, NULL)) < 0) {
+        LOGE("ff", "failed to retrieve input stream info (%s)", av_err2str(ret));
+        mmap_close_input(&inputFormatCtx);
+        return ERROR;
+    }
+    av_dump_format(inputFormatCtx, 0, inputFilename, 0);
+
+    // demux pass over the whole input, also serves as a throughput probe for the io path
+    packet = av_packet_alloc();
+    if (!packet) {
+        LOGE("ff", "failed to allocate packet");
+        mmap_close_input(&inputFormatCtx);
+        return ERROR;
+    }
+    int64_t nPackets = 0, nBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (av_read_frame(inputFormatCtx, packet) >= 0) {
+        ++nPackets;
+        nBytes += packet->size;
+        av_packet_unref(packet);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    logging("demuxed %" PRId64 " packets (%" PRId64 " bytes) in %.3f s, %.1f MB/s via %s io",
+            nPackets, nBytes, elapsed.count(), nBytes / elapsed.count() / (1 << 20),
+            useMmap ? "mmap" : "file protocol");
+
+    av_packet_free(&packet);
+    mmap_close_input(&inputFormatCtx);
+    return OK;
+}
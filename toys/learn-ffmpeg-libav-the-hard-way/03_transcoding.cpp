@@ -0,0 +1,687 @@
+/**
+ * https://github.com/leandromoreira/ffmpeg-libav-tutorial/blob/master/3_transcoding.c
+ */
+
+#include "ff_headers.h"
+#include "ff_logging.h"
+#include "ff_metrics.h"
+#include "ff_mmap_io.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace ff;
+
+#define OK 0
+#define ERROR -1
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kMaxCrf = 51;  // x264's range for 8 bit input
+constexpr int kMaxThreadCount = 1024;
+
+struct EncoderPreset {
+    const char *name;
+    const char *x264_preset;
+    const char *x264_tune;  // nullptr for none
+    int thread_type;        // of both codecs, x264 frame threads or sliced threads
+    int queue_depth;        // decoded frames in flight towards the encoder thread
+};
+
+constexpr EncoderPreset kPresets[] = {
+    // frame threads (x264 runs 1.5 x cores of them) plus the default lookahead and b-frames: the
+    // most fps, at the cost of tens of frames of delay
+    {"throughput", "veryfast", nullptr, FF_THREAD_FRAME, 16},
+    // zerolatency drops b-frames and the lookahead and switches x264 to sliced threads, so every
+    // frame sent in comes back out as a packet right away
+    {"latency", "veryfast", "zerolatency", FF_THREAD_SLICE, 1},
+};
+
+struct Options {
+    const EncoderPreset *preset = &kPresets[0];
+    bool gray = false;       // neutral chroma, luma untouched
+    bool downscale = false;  // 2:1 in both dimensions
+    int crf = 23;
+    int encoder_threads = 0;  // 0 lets x264 size it from the cores
+    int decoder_threads = 0;  // 0 lets libavcodec size it from the cores
+    bool use_mmap = false;
+    int mmap_buffer_size = kDefaultMmapIOBufferSize;
+    const char *metrics = nullptr;
+    const char *input = nullptr;
+    const char *output = nullptr;
+};
+
+// a whole decimal number in [min, max]
+bool parse_int(const char *value, long min, long max, int *result) {
+    char *end = nullptr;
+    auto n = std::strtol(value, &end, 10);
+    if (end == value || *end != '\0' || n < min || n > max) return false;
+    *result = static_cast<int>(n);
+    return true;
+}
+
+// [--preset=throughput|latency] [--gray] [--downscale] [--crf=<n>] [--encoder-threads=<n>]
+// [--decoder-threads=<n>] [--mmap] [--mmap-buffer=<bytes>] [--metrics=<file>] input output
+bool parse_options(int argc, const char *argv[], Options *options) {
+    std::vector<const char *> args;
+    for (auto i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (!std::strncmp(arg, "--preset=", 9)) {
+            options->preset = nullptr;
+            for (auto &preset : kPresets) {
+                if (!std::strcmp(arg + 9, preset.name)) options->preset = &preset;
+            }
+            if (!options->preset) {
+                LOGE("ff", "unknown preset %s", arg + 9);
+                return false;
+            }
+        } else if (!std::strcmp(arg, "--gray")) {
+            options->gray = true;
+        } else if (!std::strcmp(arg, "--downscale")) {
+            options->downscale = true;
+        } else if (!std::strncmp(arg, "--crf=", 6)) {
+            if (!parse_int(arg + 6, 0, kMaxCrf, &options->crf)) {
+                LOGE("ff", "invalid crf %s, expected 0-%d", arg + 6, kMaxCrf);
+                return false;
+            }
+        } else if (!std::strncmp(arg, "--encoder-threads=", 18)) {
+            if (!parse_int(arg + 18, 0, kMaxThreadCount, &options->encoder_threads)) {
+                LOGE("ff", "invalid encoder threads number %s", arg + 18);
+                return false;
+            }
+        } else if (!std::strncmp(arg, "--decoder-threads=", 18)) {
+            if (!parse_int(arg + 18, 0, kMaxThreadCount, &options->decoder_threads)) {
+                LOGE("ff", "invalid decoder threads number %s", arg + 18);
+                return false;
+            }
+        } else if (!std::strcmp(arg, "--mmap")) {
+            options->use_mmap = true;
+        } else if (!std::strncmp(arg, "--mmap-buffer=", 14)) {
+            options->use_mmap = true;
+            if (!parse_int(arg + 14, 1, INT_MAX, &options->mmap_buffer_size)) {
+                LOGE("ff", "invalid mmap buffer size %s", arg + 14);
+                return false;
+            }
+        } else if (!std::strncmp(arg, "--metrics=", 10)) {
+            options->metrics = arg + 10;
+        } else if (!std::strncmp(arg, "--", 2)) {
+            LOGE("ff", "unknown option %s", arg);
+            return false;
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() != 2) return false;
+    options->input = args[0];
+    options->output = args[1];
+    return true;
+}
+
+// our own kernels only handle the planar 4:2:0 layout h264 decodes to
+bool kernel_supported(int format) {
+    return format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_YUVJ420P;
+}
+
+// 2:1 box filter of one plane, `width` x `height` is the destination size
+void downscale_plane(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width,
+                     int height) {
+    for (auto y = 0; y < height; ++y) {
+        const uint8_t *row0 = src + 2 * y * srcStride;
+        const uint8_t *row1 = row0 + srcStride;
+        uint8_t *out = dst + y * dstStride;
+        for (auto x = 0; x < width; ++x) {
+            out[x] = (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) >> 2;
+        }
+    }
+}
+
+// writes the half size picture of `src` into a new frame, the only pixel pass of the pipeline
+int downscale_420p_frame(const AVFrame *src, AVFrame *dst) {
+    dst->format = src->format;
+    dst->width = (src->width / 2) & ~1;
+    dst->height = (src->height / 2) & ~1;
+    auto ret = av_frame_get_buffer(dst, 32);
+    if (ret < 0) return ret;
+    downscale_plane(src->data[0], src->linesize[0], dst->data[0], dst->linesize[0], dst->width,
+                    dst->height);
+    for (auto plane = 1; plane < 3; ++plane) {
+        downscale_plane(src->data[plane], src->linesize[plane], dst->data[plane],
+                        dst->linesize[plane], dst->width / 2, dst->height / 2);
+    }
+    return av_frame_copy_props(dst, src);
+}
+
+// points both chroma planes at one shared plane of 128s. decoder frames may still serve as
+// reference pictures, so they are never written to, and nothing gets copied either
+int gray_420p_frame(AVFrame *frame, AVBufferRef *neutral, int neutralStride) {
+    // the frame keeps its own buffers alive, the neutral plane rides along in a spare slot
+    auto slot = 0;
+    while (slot < AV_NUM_DATA_POINTERS && frame->buf[slot]) ++slot;
+    if (slot == AV_NUM_DATA_POINTERS) return AVERROR(ENOMEM);
+    frame->buf[slot] = av_buffer_ref(neutral);
+    if (!frame->buf[slot]) return AVERROR(ENOMEM);
+    frame->data[1] = frame->data[2] = neutral->data;
+    frame->linesize[1] = frame->linesize[2] = neutralStride;
+    return OK;
+}
+
+struct WorkItem {
+    AVFrame *frame = nullptr;    // video, handed over by reference
+    AVPacket *packet = nullptr;  // audio, stream copied
+    Clock::time_point demuxed;   // when the frame's packet was read, end to end latency base
+    Clock::time_point decoded;
+    bool demuxed_known = false;  // no packet with the frame's pts was seen, `demuxed` is unset
+};
+
+// bounded handoff from the decoding (main) thread to the encoding thread. it only moves
+// pointers, frame data never gets copied. an item with neither frame nor packet ends the stream
+class WorkQueue {
+   public:
+    explicit WorkQueue(size_t depth) : depth_(depth) {}
+
+    void push(const WorkItem &item) {
+        std::unique_lock<std::mutex> lock(lock_);
+        not_full_.wait(lock, [this] { return items_.size() < depth_; });
+        items_.push_back(item);
+        not_empty_.notify_one();
+    }
+
+    WorkItem pop() {
+        std::unique_lock<std::mutex> lock(lock_);
+        not_empty_.wait(lock, [this] { return !items_.empty(); });
+        auto item = items_.front();
+        items_.pop_front();
+        not_full_.notify_one();
+        return item;
+    }
+
+   private:
+    size_t depth_;
+    std::mutex lock_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<WorkItem> items_;
+};
+
+struct Pipeline {
+    AVFormatContext *input = nullptr;
+    AVFormatContext *output = nullptr;
+    AVCodecContext *decoder = nullptr;
+    AVCodecContext *encoder = nullptr;
+    int video_in = -1, audio_in = -1;
+    int video_out = -1, audio_out = -1;
+    AVBufferRef *neutral = nullptr;  // shared chroma plane of --gray
+    int neutral_stride = 0;
+
+    // decoding thread
+    std::unordered_map<int64_t, Clock::time_point> demuxed_at;  // by packet pts
+    int64_t frames = 0;
+    int64_t frames_without_demux = 0;  // left out of the end to end latency
+
+    // encoding thread
+    struct Timestamps {
+        Clock::time_point demuxed, decoded;
+        bool demuxed_known;
+    };
+    std::unordered_map<int64_t, Timestamps> in_flight;  // by frame pts
+    std::vector<double> total_ms;                        // demuxed -> muxed, per frame
+    std::vector<double> encode_ms;                       // decoded -> muxed, per frame
+    std::atomic<int> encode_status{OK};
+};
+
+double ms_between(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+int mux_packet(Pipeline *p, AVPacket *packet, AVRational timeBase, int stream) {
+    FF_METRIC_TIMER(kStageMux);
+    FF_METRIC_BYTES(kStageMux, packet->size, 0);
+    av_packet_rescale_ts(packet, timeBase, p->output->streams[stream]->time_base);
+    packet->stream_index = stream;
+    packet->pos = -1;
+    // takes over the packet's reference
+    return av_interleaved_write_frame(p->output, packet);
+}
+
+// muxes what the encoder has ready, the time spent in avcodec_receive_packet adds to `*encodeTicks`
+int drain_encoder(Pipeline *p, AVPacket *packet, uint64_t *encodeTicks) {
+    while (true) {
+        int response;
+        {
+            FF_METRIC_TICKS(encodeTicks);
+            response = avcodec_receive_packet(p->encoder, packet);
+        }
+        if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) return OK;
+        if (response < 0) {
+            LOGE("ff", "in receiving packet from encoder (%s)", av_err2str(response));
+            return response;
+        }
+        FF_METRIC_BYTES(kStageEncode, 0, packet->size);
+
+        auto pts = packet->pts;
+        response = mux_packet(p, packet, p->encoder->time_base, p->video_out);
+        if (response < 0) {
+            LOGE("ff", "in muxing video packet (%s)", av_err2str(response));
+            return response;
+        }
+        auto muxed = Clock::now();
+        auto it = p->in_flight.find(pts);
+        if (it != p->in_flight.end()) {
+            p->encode_ms.push_back(ms_between(it->second.decoded, muxed));
+            if (it->second.demuxed_known) {
+                p->total_ms.push_back(ms_between(it->second.demuxed, muxed));
+                LOGD("latency", "pts %" PRId64 " end to end %.2f ms, encode + mux %.2f ms", pts,
+                     p->total_ms.back(), p->encode_ms.back());
+            } else {
+                LOGD("latency", "pts %" PRId64 " encode + mux %.2f ms", pts, p->encode_ms.back());
+            }
+            p->in_flight.erase(it);
+        }
+    }
+}
+
+// body of the encoding thread: frames go into x264 in the order they were decoded, packets of
+// both streams go to the muxer from this thread only
+void encode_loop(Pipeline *p, WorkQueue *queue) {
+    AVPacket *packet = av_packet_alloc();
+    int response = packet ? OK : AVERROR(ENOMEM);
+    if (response < 0) p->encode_status = response;
+    while (true) {
+        auto item = queue->pop();
+        if (!item.frame && !item.packet) break;
+
+        // after a failure the queue is only emptied, the decoding thread must never block on a
+        // full one while it notices
+        if (response >= 0 && item.packet) {
+            response = mux_packet(p, item.packet, p->input->streams[p->audio_in]->time_base,
+                                  p->audio_out);
+            if (response < 0) LOGE("ff", "in muxing audio packet (%s)", av_err2str(response));
+        } else if (response >= 0) {
+            p->in_flight[item.frame->pts] = {item.demuxed, item.decoded, item.demuxed_known};
+            // one sample per frame: the send plus the receives it made possible, without muxing
+            uint64_t encodeTicks = 0;
+            {
+                FF_METRIC_TICKS(&encodeTicks);
+                response = avcodec_send_frame(p->encoder, item.frame);
+            }
+            if (response < 0) {
+                LOGE("ff", "in sending frame to encoder (%s)", av_err2str(response));
+            } else {
+                response = drain_encoder(p, packet, &encodeTicks);
+            }
+            FF_METRIC_RECORD(kStageEncode, encodeTicks);
+        }
+        // the encoder holds its own reference to a frame it took
+        av_frame_free(&item.frame);
+        av_packet_free(&item.packet);
+        // published right away, so the decoding thread stops demuxing and decoding
+        if (response < 0) p->encode_status = response;
+    }
+
+    // flush the frames still in the lookahead / frame threads, one more sample
+    uint64_t encodeTicks = 0;
+    if (response >= 0) {
+        FF_METRIC_TICKS(&encodeTicks);
+        response = avcodec_send_frame(p->encoder, NULL);
+    }
+    if (response >= 0) {
+        response = drain_encoder(p, packet, &encodeTicks);
+        FF_METRIC_RECORD(kStageEncode, encodeTicks);
+    }
+    av_packet_free(&packet);
+    p->encode_status = response < 0 ? response : OK;
+}
+
+// decodes `packet` (NULL flushes) and queues every frame it yields, after the optional kernels
+int decode_packet(Pipeline *p, const Options &options, AVPacket *packet, AVFrame *frame,
+                  WorkQueue *queue) {
+    int response;
+    {
+        FF_METRIC_TIMER(kStageSendPacket);
+        response = avcodec_send_packet(p->decoder, packet);
+    }
+    if (packet) FF_METRIC_BYTES(kStageSendPacket, packet->size, 0);
+    if (response < 0) {
+        LOGE("ff", "in sending packet to decoder (%s)", av_err2str(response));
+        return response;
+    }
+
+    while (true) {
+        {
+            FF_METRIC_TIMER(kStageReceiveFrame);
+            response = avcodec_receive_frame(p->decoder, frame);
+        }
+        if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) return OK;
+        if (response < 0) {
+            LOGE("ff", "in receiving frame from decoder (%s)", av_err2str(response));
+            return response;
+        }
+
+        WorkItem item;
+        item.decoded = Clock::now();
+        auto it = p->demuxed_at.find(frame->pts);
+        if (it != p->demuxed_at.end()) {
+            item.demuxed = it->second;
+            item.demuxed_known = true;
+            // frames come out in presentation order, packets before this one that never matched
+            // a frame (dropped, or pts rewritten by the decoder) never will
+            auto pts = frame->pts;
+            for (auto entry = p->demuxed_at.begin(); entry != p->demuxed_at.end();) {
+                entry = entry->first <= pts ? p->demuxed_at.erase(entry) : std::next(entry);
+            }
+        } else {
+            ++p->frames_without_demux;
+        }
+
+        // x264 gets the presentation timestamps in the input stream's time base and picks its own
+        // frame types rather than the source's
+        frame->pts = frame->best_effort_timestamp;
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+
+        item.frame = av_frame_alloc();
+        if (!item.frame) return AVERROR(ENOMEM);
+        {
+            FF_METRIC_TIMER(kStageProcessFrame);
+            if (options.downscale) {
+                response = downscale_420p_frame(frame, item.frame);
+                av_frame_unref(frame);
+            } else {
+                av_frame_move_ref(item.frame, frame);
+            }
+            if (response >= 0 && options.gray) {
+                response = gray_420p_frame(item.frame, p->neutral, p->neutral_stride);
+            }
+        }
+        if (response < 0) {
+            LOGE("ff", "in processing frame (%s)", av_err2str(response));
+            av_frame_free(&item.frame);
+            return response;
+        }
+
+        if (p->encode_status != OK) {
+            av_frame_free(&item.frame);
+            return p->encode_status;
+        }
+        ++p->frames;
+        queue->push(item);
+    }
+}
+
+int open_decoder(Pipeline *p, const Options &options) {
+    auto *stream = p->input->streams[p->video_in];
+    auto *codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        LOGE("ff", "unsupported video codec");
+        return ERROR;
+    }
+    p->decoder = avcodec_alloc_context3(codec);
+    if (!p->decoder) {
+        LOGE("ff", "failed to allocate decoder context");
+        return ERROR;
+    }
+    if (avcodec_parameters_to_context(p->decoder, stream->codecpar) < 0) {
+        LOGE("ff", "failed to copy video codec params");
+        return ERROR;
+    }
+    p->decoder->pkt_timebase = stream->time_base;
+    // libavcodec defaults to a single thread, which would cap the whole pipeline at the decoder's
+    // speed. frame threads hold a frame back per thread, so the latency preset uses slices
+    p->decoder->thread_count = options.decoder_threads;
+    p->decoder->thread_type = options.preset->thread_type;
+    if (avcodec_open2(p->decoder, codec, NULL) < 0) {
+        LOGE("ff", "failed to open video decoder through avcodec_open2");
+        return ERROR;
+    }
+
+    if ((options.gray || options.downscale) && !kernel_supported(p->decoder->pix_fmt)) {
+        LOGE("ff", "--gray / --downscale need yuv420p input, got %s",
+             av_get_pix_fmt_name(p->decoder->pix_fmt));
+        return ERROR;
+    }
+    if (options.gray) {
+        p->neutral_stride = ((p->decoder->width + 1) / 2 + 63) & ~63;
+        p->neutral = av_buffer_alloc(p->neutral_stride * ((p->decoder->height + 1) / 2));
+        if (!p->neutral) {
+            LOGE("ff", "failed to allocate neutral chroma plane");
+            return ERROR;
+        }
+        std::memset(p->neutral->data, 128, p->neutral->size);
+    }
+    return OK;
+}
+
+int open_encoder(Pipeline *p, const Options &options) {
+    auto *codec = avcodec_find_encoder_by_name("libx264");
+    if (!codec) {
+        LOGE("ff", "libx264 encoder not found, build FFmpeg with --enable-libx264");
+        return ERROR;
+    }
+    p->encoder = avcodec_alloc_context3(codec);
+    if (!p->encoder) {
+        LOGE("ff", "failed to allocate encoder context");
+        return ERROR;
+    }
+
+    auto *stream = p->input->streams[p->video_in];
+    p->encoder->width = options.downscale ? (p->decoder->width / 2) & ~1 : p->decoder->width;
+    p->encoder->height = options.downscale ? (p->decoder->height / 2) & ~1 : p->decoder->height;
+    p->encoder->pix_fmt = p->decoder->pix_fmt;
+    p->encoder->sample_aspect_ratio = p->decoder->sample_aspect_ratio;
+    p->encoder->time_base = stream->time_base;
+    p->encoder->framerate = av_guess_frame_rate(p->input, stream, NULL);
+    p->encoder->thread_count = options.encoder_threads;
+    p->encoder->thread_type = options.preset->thread_type;
+    if (p->output->oformat->flags & AVFMT_GLOBALHEADER) {
+        p->encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    av_opt_set(p->encoder->priv_data, "preset", options.preset->x264_preset, 0);
+    if (options.preset->x264_tune) {
+        av_opt_set(p->encoder->priv_data, "tune", options.preset->x264_tune, 0);
+    }
+    av_opt_set(p->encoder->priv_data, "crf", std::to_string(options.crf).c_str(), 0);
+
+    if (avcodec_open2(p->encoder, codec, NULL) < 0) {
+        LOGE("ff", "failed to open libx264 through avcodec_open2");
+        return ERROR;
+    }
+    logging("encoder: libx264 %s%s%s, %d x %d, %s threads", options.preset->x264_preset,
+            options.preset->x264_tune ? " tune " : "",
+            options.preset->x264_tune ? options.preset->x264_tune : "", p->encoder->width,
+            p->encoder->height, options.preset->thread_type == FF_THREAD_FRAME ? "frame" : "slice");
+    return OK;
+}
+
+// video gets re-encoded into stream 0, the first audio stream is copied as is, the rest dropped
+int open_output(Pipeline *p, const Options &options) {
+    if (avformat_alloc_output_context2(&p->output, NULL, NULL, options.output) < 0) {
+        LOGE("ff", "could not allocate memory for output format");
+        return ERROR;
+    }
+
+    auto *video = avformat_new_stream(p->output, NULL);
+    if (!video || open_encoder(p, options) != OK) return ERROR;
+    if (avcodec_parameters_from_context(video->codecpar, p->encoder) < 0) {
+        LOGE("ff", "failed to copy encoder params");
+        return ERROR;
+    }
+    video->time_base = p->encoder->time_base;
+    p->video_out = video->index;
+
+    if (p->audio_in >= 0) {
+        auto *audio = avformat_new_stream(p->output, NULL);
+        if (!audio) return ERROR;
+        if (avcodec_parameters_copy(audio->codecpar, p->input->streams[p->audio_in]->codecpar) <
+            0) {
+            LOGE("ff", "failed to copy audio codec params");
+            return ERROR;
+        }
+        audio->codecpar->codec_tag = 0;
+        audio->time_base = p->input->streams[p->audio_in]->time_base;
+        p->audio_out = audio->index;
+    }
+
+    if (!(p->output->oformat->flags & AVFMT_NOFILE) &&
+        avio_open(&p->output->pb, options.output, AVIO_FLAG_WRITE) < 0) {
+        LOGE("ff", "could not open output file %s", options.output);
+        return ERROR;
+    }
+    if (avformat_write_header(p->output, NULL) < 0) {
+        LOGE("ff", "an error occurred when opening output file");
+        return ERROR;
+    }
+    av_dump_format(p->output, 0, options.output, 1);
+    return OK;
+}
+
+void report_latency(const char *name, std::vector<double> samples) {
+    if (samples.empty()) return;
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (auto v : samples) sum += v;
+    auto percentile = [&](double q) {
+        return samples[std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()))];
+    };
+    logging("%s latency over %zu frames: avg %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms", name,
+            samples.size(), sum / samples.size(), percentile(0.5), percentile(0.99),
+            samples.back());
+}
+
+int transcode(Pipeline *p, const Options &options) {
+    auto *packet = av_packet_alloc();
+    auto *frame = av_frame_alloc();
+    if (!packet || !frame) {
+        LOGE("ff", "failed to allocate packet or frame");
+        av_packet_free(&packet);
+        av_frame_free(&frame);
+        return ERROR;
+    }
+
+    auto start = Clock::now();
+    WorkQueue queue(options.preset->queue_depth);
+    std::thread encoder(encode_loop, p, &queue);
+
+    int response = OK;
+    while (p->encode_status == OK) {
+        {
+            FF_METRIC_TIMER(kStageDemux);
+            if (av_read_frame(p->input, packet) < 0) break;
+        }
+        FF_METRIC_BYTES(kStageDemux, 0, packet->size);
+        if (packet->stream_index == p->video_in) {
+            if (packet->pts != AV_NOPTS_VALUE) p->demuxed_at[packet->pts] = Clock::now();
+            response = decode_packet(p, options, packet, frame, &queue);
+            av_packet_unref(packet);
+            if (response < 0) break;
+        } else if (packet->stream_index == p->audio_in) {
+            WorkItem item;
+            item.packet = av_packet_alloc();
+            if (!item.packet) {
+                response = AVERROR(ENOMEM);
+                break;
+            }
+            av_packet_move_ref(item.packet, packet);
+            if (p->encode_status != OK) {
+                av_packet_free(&item.packet);
+                break;
+            }
+            queue.push(item);
+        } else {
+            av_packet_unref(packet);
+        }
+    }
+    // frames still buffered in the decoder
+    if (response >= 0) response = decode_packet(p, options, NULL, frame, &queue);
+    queue.push(WorkItem{});
+    encoder.join();
+    if (response >= 0) response = p->encode_status;
+    if (response >= 0) response = av_write_trailer(p->output);
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    auto fps = av_q2d(p->encoder->framerate);
+    auto mediaSeconds = fps > 0 ? p->frames / fps : 0;
+    logging("transcoded %" PRId64 " frames in %.3f s: %.1f fps, %.2fx real time (%s preset)",
+            p->frames, elapsed.count(), p->frames / elapsed.count(),
+            mediaSeconds / elapsed.count(), options.preset->name);
+    report_latency("end to end", p->total_ms);
+    if (p->frames_without_demux) {
+        logging("%" PRId64 " frames without a demux timestamp skipped from the end to end latency",
+                p->frames_without_demux);
+    }
+    report_latency("encode + mux", p->encode_ms);
+
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    return response < 0 ? response : OK;
+}
+
+int main(int argc, const char *argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        logging("please provide an input and an output file");
+        return ERROR;
+    }
+
+    logging("initializing");
+    if (options.metrics) metrics_export_at_exit(options.metrics);
+
+    Pipeline p;
+    auto release = [&](int ret) {
+        if (p.output && !(p.output->oformat->flags & AVFMT_NOFILE)) avio_closep(&p.output->pb);
+        avformat_free_context(p.output);
+        avcodec_free_context(&p.encoder);
+        avcodec_free_context(&p.decoder);
+        av_buffer_unref(&p.neutral);
+        mmap_close_input(&p.input);
+        return ret;
+    };
+
+    auto ret = options.use_mmap ? mmap_open_input(&p.input, options.input, options.mmap_buffer_size)
+                                : avformat_open_input(&p.input, options.input, NULL, NULL);
+    if (ret < 0) {
+        LOGE("ff", "failed to open input file %s (%s)", options.input, av_err2str(ret));
+        return ERROR;
+    }
+    if (avformat_find_stream_info(p.input, NULL) < 0) {
+        LOGE("ff", "failed to retrieve input stream info");
+        return release(ERROR);
+    }
+    av_dump_format(p.input, 0, options.input, 0);
+
+    for (auto i = 0; i < p.input->nb_streams; ++i) {
+        auto type = p.input->streams[i]->codecpar->codec_type;
+        if (type == AVMEDIA_TYPE_VIDEO && p.video_in < 0) {
+            p.video_in = i;
+        } else if (type == AVMEDIA_TYPE_AUDIO && p.audio_in < 0) {
+            p.audio_in = i;
+        } else {
+            p.input->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    if (p.video_in < 0) {
+        LOGE("ff", "no video stream in %s", options.input);
+        return release(ERROR);
+    }
+
+    if (open_decoder(&p, options) != OK || open_output(&p, options) != OK) return release(ERROR);
+    ret = transcode(&p, options);
+    if (ret != OK) {
+        LOGE("ff", "failed to transcode %s (%s)", options.input, av_err2str(ret));
+        return release(ERROR);
+    }
+    logging("OK: transcoded %s to %s", options.input, options.output);
+    return release(OK);
+}
@@ -0,0 +1,121 @@
+/**
+ * per-call cost of ff_logger on the calling thread, compared with the old synchronous
+ * fprintf(stderr) logging. everything is written to an unbuffered /dev/null
+ */
+
+// pin the build time level here so the trace case below is really compiled out
+#undef FF_LOG_MIN_LEVEL
+#define FF_LOG_MIN_LEVEL 1
+
+#include "ff_logger.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace ff;
+
+constexpr int kCalls = 1000000;
+constexpr int kThreads = 4;
+
+std::FILE *devnull = nullptr;
+
+// the baseline: what ff::logging did before, three stdio calls per message
+void sync_logging(const char *fmt, ...) {
+    std::va_list args;
+    flockfile(devnull);
+    std::fprintf(devnull, "LOG: ");
+    va_start(args, fmt);
+    std::vfprintf(devnull, fmt, args);
+    va_end(args);
+    std::fprintf(devnull, "\n");
+    funlockfile(devnull);
+}
+
+// runs `body(i)` kCalls times on each of `threads` threads, returns ns per call as seen by callers
+template <typename Body>
+double ns_per_call(int threads, Body body) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (auto t = 0; t < threads; ++t) {
+        pool.emplace_back([&] {
+            for (auto i = 0; i < kCalls; ++i) body(i);
+        });
+    }
+    for (auto &thread : pool) thread.join();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / kCalls;
+}
+
+// caller side cost when messages come in bursts that fit the ring, which is how the decode loop
+// logs. the drain thread catches up between bursts, outside of the timed region
+template <typename Body>
+double ns_per_call_in_bursts(Body body) {
+    constexpr int kBurst = 256;
+    std::chrono::duration<double, std::nano> elapsed{0};
+    for (auto n = 0; n < kCalls; n += kBurst) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto i = n; i < n + kBurst; ++i) body(i);
+        elapsed += std::chrono::steady_clock::now() - start;
+        log_flush();
+    }
+    return elapsed.count() / kCalls;
+}
+
+void report(const char *name, double ns) { std::printf("%-40s %10.1f ns/call\n", name, ns); }
+
+int main() {
+    devnull = std::fopen("/dev/null", "w");
+    if (!devnull) return -1;
+    // unbuffered like stderr, the sync baseline pays one write() per stdio call as it used to
+    std::setvbuf(devnull, nullptr, _IONBF, 0);
+    set_log_output(devnull);
+    set_log_level(kLogInfo);
+    set_log_level(kLogOff, "quiet");
+
+    int64_t pts = 1234567;
+    report("compiled out (trace)", ns_per_call(1, [&](int i) {
+               LOGT("bench", "frame %d pts %" PRId64, i, pts);
+           }));
+    report("filtered at runtime (debug)", ns_per_call(1, [&](int i) {
+               LOGD("bench", "frame %d pts %" PRId64, i, pts);
+           }));
+    report("filtered by module (info, quiet=off)", ns_per_call(1, [&](int i) {
+               LOGI("quiet", "frame %d pts %" PRId64, i, pts);
+           }));
+
+    report("sync fprintf, bursts", ns_per_call_in_bursts([&](int i) {
+               sync_logging("frame %d pts %" PRId64, i, pts);
+           }));
+    report("async ring, bursts", ns_per_call_in_bursts([&](int i) {
+               LOGI("bench", "frame %d pts %" PRId64, i, pts);
+           }));
+
+    // sustained: callers outrun the drain thread and wait for ring space
+    report("sync fprintf, 1 thread", ns_per_call(1, [&](int i) {
+               sync_logging("frame %d pts %" PRId64, i, pts);
+           }));
+    report("async ring, 1 thread", ns_per_call(1, [&](int i) {
+               LOGI("bench", "frame %d pts %" PRId64, i, pts);
+           }));
+    auto start = std::chrono::steady_clock::now();
+    log_flush();
+    std::chrono::duration<double, std::nano> flush = std::chrono::steady_clock::now() - start;
+    report("  + drain backlog, per message", flush.count() / kCalls);
+
+    report("sync fprintf, 4 threads", ns_per_call(kThreads, [&](int i) {
+               sync_logging("frame %d pts %" PRId64, i, pts);
+           }));
+    report("async ring, 4 threads", ns_per_call(kThreads, [&](int i) {
+               LOGI("bench", "frame %d pts %" PRId64, i, pts);
+           }));
+    log_flush();
+
+    set_log_output(nullptr);
+    std::fclose(devnull);
+    return 0;
+}
@@ -0,0 +1,66 @@
+/**
+ * per-call cost of the ff_metrics stage timers and byte counters on the calling thread. the empty
+ * loop is what FF_METRICS=0 leaves of them
+ */
+
+#include "ff_metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace ff;
+
+constexpr int kCalls = 10000000;
+constexpr int kThreads = 4;
+
+// keeps the loop bodies from being optimized away, per thread so threads don't share its line
+thread_local volatile uint64_t sink = 0;
+
+// runs `body(i)` kCalls times on each of `threads` threads, returns ns of cpu time per call.
+// threads beyond the cores just take turns, so they don't count as running in parallel
+template <typename Body>
+double ns_per_call(int threads, Body body) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (auto t = 0; t < threads; ++t) {
+        pool.emplace_back([&] {
+            // registration is a one time cost per thread, not part of the per call one
+            thread_stage_metrics();
+            for (auto i = 0; i < kCalls; ++i) body(i);
+        });
+    }
+    for (auto &thread : pool) thread.join();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    auto parallel = std::min<unsigned>(threads, std::max(1u, std::thread::hardware_concurrency()));
+    return elapsed.count() * parallel / (static_cast<double>(kCalls) * threads);
+}
+
+void report(const char *name, double ns) { std::printf("%-40s %10.1f ns/call\n", name, ns); }
+
+int main() {
+    report("empty loop (FF_METRICS=0)", ns_per_call(1, [](int i) { sink = i; }));
+    report("metric_ticks", ns_per_call(1, [](int i) { sink = metric_ticks(); }));
+    report("FF_METRIC_BYTES", ns_per_call(1, [](int i) {
+               FF_METRIC_BYTES(kStageDemux, i, i);
+               sink = i;
+           }));
+    report("FF_METRIC_TIMER", ns_per_call(1, [](int i) {
+               FF_METRIC_TIMER(kStageDemux);
+               sink = i;
+           }));
+    report("FF_METRIC_TIMER + FF_METRIC_BYTES", ns_per_call(1, [](int i) {
+               FF_METRIC_TIMER(kStageDemux);
+               FF_METRIC_BYTES(kStageDemux, i, 0);
+               sink = i;
+           }));
+    // per thread arrays, so more threads should not cost more per call
+    report("FF_METRIC_TIMER, 4 threads", ns_per_call(kThreads, [](int i) {
+               FF_METRIC_TIMER(kStageDemux);
+               sink = i;
+           }));
+    return 0;
+}
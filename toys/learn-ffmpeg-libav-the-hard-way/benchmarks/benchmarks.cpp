@@ -0,0 +1,378 @@
+/**
+ * decode throughput on deterministic synthetic streams, encoded once at startup from generated
+ * frames (QCIF to 4K). optionally also the video of a real file
+ */
+
+#include "ff_headers.h"
+#include "ff_logging.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace ff;
+
+#define OK 0
+#define ERROR -1
+
+constexpr double kWarmupSeconds = 0.1;
+constexpr int kMinWarmupIters = 3;
+constexpr double kTargetRepSeconds = 0.1;
+
+struct Resolution {
+    const char *name;
+    int width;
+    int height;
+    int frames;
+};
+
+constexpr Resolution kResolutions[] = {
+    {"qcif", 176, 144, 60},    {"cif", 352, 288, 60},     {"720p", 1280, 720, 60},
+    {"1080p", 1920, 1080, 60}, {"4k", 3840, 2160, 30},
+};
+
+struct Options {
+    int reps = 5;
+    std::string filter;
+    std::string json;
+    const char *input = nullptr;
+};
+
+// the harness below is kept identical in both projects' benchmarks.cpp: same warm-up policy, same
+// table and the same json schema, so results of the two drivers compare directly
+
+struct Result {
+    std::string name;
+    std::string input;
+    uint64_t bytes;  // processed per iteration
+    int items;       // frames or NAL units per iteration
+    int iters;       // per repetition
+    std::vector<double> ns;  // per iteration, one sample per repetition
+    double min, median, mean, stddev;
+};
+
+std::vector<Result> results;
+
+void summarize(Result *result) {
+    auto sorted = result->ns;
+    std::sort(sorted.begin(), sorted.end());
+    auto n = sorted.size();
+    result->min = sorted.front();
+    result->median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    double sum = 0, sq = 0;
+    for (auto v : sorted) sum += v;
+    result->mean = sum / n;
+    for (auto v : sorted) sq += (v - result->mean) * (v - result->mean);
+    result->stddev = n > 1 ? std::sqrt(sq / (n - 1)) : 0;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void print_header() {
+    std::printf("%-22s %-14s %12s %12s %9s %10s %12s\n", "benchmark", "input", "median(us)",
+                "min(us)", "stddev", "MB/s", "items/s");
+}
+
+// warms `body` up for kWarmupSeconds (and at least kMinWarmupIters), sizes a repetition to
+// ~kTargetRepSeconds, then times `reps` repetitions
+void run(const Options &options, const std::string &name, const std::string &input,
+         uint64_t bytes, int items, const std::function<void()> &body) {
+    if (!options.filter.empty() && (name + "/" + input).find(options.filter) == std::string::npos) {
+        return;
+    }
+
+    int warmup_iters = 0;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        body();
+        ++warmup_iters;
+    } while (seconds_since(start) < kWarmupSeconds || warmup_iters < kMinWarmupIters);
+    auto per_iter = seconds_since(start) / warmup_iters;
+    auto iters = std::max(1, static_cast<int>(kTargetRepSeconds / per_iter));
+
+    Result result{name, input, bytes, items, iters, {}, 0, 0, 0, 0};
+    for (auto rep = 0; rep < options.reps; ++rep) {
+        start = std::chrono::steady_clock::now();
+        for (auto i = 0; i < iters; ++i) body();
+        result.ns.push_back(seconds_since(start) * 1e9 / iters);
+    }
+    summarize(&result);
+    std::printf("%-22s %-14s %12.1f %12.1f %8.2f%% %10.1f %12.1f\n", name.c_str(), input.c_str(),
+                result.median / 1e3, result.min / 1e3, result.stddev / result.mean * 100,
+                bytes / (result.median / 1e9) / (1 << 20), items / (result.median / 1e9));
+    results.push_back(result);
+}
+
+void write_json(const std::string &path, const char *suite, uint32_t seed) {
+    auto *file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::fprintf(stderr, "failed to open %s\n", path.c_str());
+        return;
+    }
+    std::fprintf(file, "{\n  \"suite\": \"%s\",\n  \"seed\": %u,\n  \"benchmarks\": [\n", suite,
+                 seed);
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto &r = results[i];
+        std::fprintf(file,
+                     "    {\"name\": \"%s\", \"input\": \"%s\", \"bytes\": %llu, \"items\": %d, "
+                     "\"iters\": %d, \"reps\": %zu, \"ns_min\": %.1f, \"ns_median\": %.1f, "
+                     "\"ns_mean\": %.1f, \"ns_stddev\": %.1f, \"mb_per_s\": %.2f, "
+                     "\"items_per_s\": %.2f}%s\n",
+                     r.name.c_str(), r.input.c_str(), static_cast<unsigned long long>(r.bytes),
+                     r.items, r.iters, r.ns.size(), r.min, r.median, r.mean, r.stddev,
+                     r.bytes / (r.median / 1e9) / (1 << 20), r.items / (r.median / 1e9),
+                     i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+    std::fclose(file);
+}
+
+struct EncodedStream {
+    AVCodecParameters *params = nullptr;
+    std::vector<AVPacket *> packets;
+    int frames = 0;
+    uint64_t decoded_bytes = 0;
+};
+
+void release_stream(EncodedStream *stream) {
+    for (auto *packet : stream->packets) av_packet_free(&packet);
+    stream->packets.clear();
+    avcodec_parameters_free(&stream->params);
+}
+
+
+// moving gradients, cheap to generate and still give the encoder real motion to code
+void fill_frame(AVFrame *frame, int index) {
+    for (auto y = 0; y < frame->height; ++y) {
+        auto *row = frame->data[0] + y * frame->linesize[0];
+        for (auto x = 0; x < frame->width; ++x) row[x] = static_cast<uint8_t>(x + y + index * 3);
+    }
+    for (auto y = 0; y < frame->height / 2; ++y) {
+        auto *u = frame->data[1] + y * frame->linesize[1];
+        auto *v = frame->data[2] + y * frame->linesize[2];
+        for (auto x = 0; x < frame->width / 2; ++x) {
+            u[x] = static_cast<uint8_t>(128 + y + index * 2);
+            v[x] = static_cast<uint8_t>(64 + x + index * 5);
+        }
+    }
+}
+
+int drain_packets(AVCodecContext *context, EncodedStream *stream) {
+    while (true) {
+        auto *packet = av_packet_alloc();
+        if (!packet) return AVERROR(ENOMEM);
+        auto ret = avcodec_receive_packet(context, packet);
+        if (ret < 0) {
+            av_packet_free(&packet);
+            return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? OK : ret;
+        }
+        stream->packets.push_back(packet);
+    }
+}
+
+// h264 through libx264 when FFmpeg has it (see install.sh), mpeg4 otherwise
+int encode_synthetic(const Resolution &res, EncodedStream *stream) {
+    auto *codec = avcodec_find_encoder_by_name("libx264");
+    if (!codec) codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+    if (!codec) {
+        LOGE("ff", "no h264 or mpeg4 encoder");
+        return ERROR;
+    }
+
+    auto *context = avcodec_alloc_context3(codec);
+    auto *frame = av_frame_alloc();
+    if (!context || !frame) {
+        LOGE("ff", "failed to allocate encoder");
+        avcodec_free_context(&context);
+        av_frame_free(&frame);
+        return ERROR;
+    }
+    context->width = res.width;
+    context->height = res.height;
+    context->pix_fmt = AV_PIX_FMT_YUV420P;
+    context->time_base = AVRational{1, 30};
+    context->framerate = AVRational{30, 1};
+    context->gop_size = 30;
+    context->bit_rate = static_cast<int64_t>(res.width) * res.height * 4;
+    av_opt_set(context->priv_data, "preset", "ultrafast", 0);
+
+    auto ret = avcodec_open2(context, codec, NULL);
+    if (ret >= 0) {
+        frame->format = context->pix_fmt;
+        frame->width = res.width;
+        frame->height = res.height;
+        ret = av_frame_get_buffer(frame, 0);
+    }
+    for (auto i = 0; ret >= 0 && i < res.frames; ++i) {
+        ret = av_frame_make_writable(frame);
+        if (ret < 0) break;
+        fill_frame(frame, i);
+        frame->pts = i;
+        ret = avcodec_send_frame(context, frame);
+        if (ret >= 0) ret = drain_packets(context, stream);
+    }
+    if (ret >= 0) ret = avcodec_send_frame(context, NULL);
+    if (ret >= 0) ret = drain_packets(context, stream);
+    if (ret >= 0) {
+        stream->params = avcodec_parameters_alloc();
+        ret = stream->params ? avcodec_parameters_from_context(stream->params, context)
+                             : AVERROR(ENOMEM);
+    }
+    if (ret < 0) LOGE("ff", "failed to encode %s (%s)", res.name, av_err2str(ret));
+
+    stream->frames = res.frames;
+    stream->decoded_bytes = static_cast<uint64_t>(res.width) * res.height * 3 / 2 * res.frames;
+    av_frame_free(&frame);
+    avcodec_free_context(&context);
+    return ret < 0 ? ERROR : OK;
+}
+
+// video packets of a real file, demuxed once into memory so only decoding gets timed
+int load_file(const char *filename, EncodedStream *stream) {
+    AVFormatContext *context = nullptr;
+    if (avformat_open_input(&context, filename, NULL, NULL) < 0) {
+        LOGE("ff", "failed to open %s", filename);
+        return ERROR;
+    }
+    avformat_find_stream_info(context, NULL);
+    auto index = av_find_best_stream(context, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (index < 0) {
+        LOGE("ff", "no video stream in %s", filename);
+        avformat_close_input(&context);
+        return ERROR;
+    }
+    stream->params = avcodec_parameters_alloc();
+    avcodec_parameters_copy(stream->params, context->streams[index]->codecpar);
+
+    auto *packet = av_packet_alloc();
+    while (av_read_frame(context, packet) >= 0) {
+        if (packet->stream_index == index) {
+            auto *copy = av_packet_alloc();
+            av_packet_move_ref(copy, packet);
+            stream->packets.push_back(copy);
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+    avformat_close_input(&context);
+    return OK;
+}
+
+struct Decoder {
+    AVCodecContext *context = nullptr;
+    AVFrame *frame = nullptr;
+};
+
+void close_decoder(Decoder *decoder) {
+    av_frame_free(&decoder->frame);
+    avcodec_free_context(&decoder->context);
+}
+
+// opened once per configuration, so opening and tearing down the decoder (and its thread pool)
+// stays out of the timed body
+int open_decoder(const EncodedStream &stream, int threads, Decoder *decoder) {
+    auto *codec = avcodec_find_decoder(stream.params->codec_id);
+    decoder->context = avcodec_alloc_context3(codec);
+    decoder->frame = av_frame_alloc();
+    if (!codec || !decoder->context || !decoder->frame ||
+        avcodec_parameters_to_context(decoder->context, stream.params) < 0) {
+        close_decoder(decoder);
+        return ERROR;
+    }
+    decoder->context->thread_count = threads;
+    if (avcodec_open2(decoder->context, codec, NULL) < 0) {
+        close_decoder(decoder);
+        return ERROR;
+    }
+    return OK;
+}
+
+// send every packet and drain the decoder, then reset it for the next pass. returns decoded
+// frames
+int decode_all(const EncodedStream &stream, Decoder *decoder) {
+    int frames = 0;
+    for (size_t i = 0; i <= stream.packets.size(); ++i) {
+        // one past the end sends the flush packet
+        if (avcodec_send_packet(decoder->context,
+                                i < stream.packets.size() ? stream.packets[i] : NULL) < 0) {
+            break;
+        }
+        while (avcodec_receive_frame(decoder->context, decoder->frame) >= 0) ++frames;
+    }
+    avcodec_flush_buffers(decoder->context);
+    return frames;
+}
+
+void bench_decode(const Options &options, const std::string &input, EncodedStream *stream) {
+    auto *codec = avcodec_find_decoder(stream->params->codec_id);
+    if (!codec) {
+        LOGE("ff", "no decoder for %s", input.c_str());
+        return;
+    }
+    auto name = std::string{"decode_"} + codec->name;
+    // single threaded, then libavcodec's own frame/slice threading with a thread per core
+    for (auto threads : {1, 0}) {
+        Decoder decoder;
+        if (open_decoder(*stream, threads, &decoder) != OK) {
+            LOGE("ff", "failed to open %s decoder for %s", codec->name, input.c_str());
+            return;
+        }
+        auto frames = decode_all(*stream, &decoder);
+        if (!stream->frames) {
+            stream->frames = frames;
+            stream->decoded_bytes = static_cast<uint64_t>(stream->params->width) *
+                                    stream->params->height * 3 / 2 * frames;
+        }
+        run(options, name, input + (threads ? "/t1" : "/auto"), stream->decoded_bytes,
+            stream->frames, [&] { decode_all(*stream, &decoder); });
+        close_decoder(&decoder);
+    }
+}
+
+// benchmarks [--reps=<n>] [--filter=<substring>] [--json=<file>] [--input=<media file>]
+int main(int argc, const char *argv[]) {
+    Options options;
+    for (auto i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (!std::strncmp(arg, "--reps=", 7)) {
+            options.reps = std::max(1, std::atoi(arg + 7));
+        } else if (!std::strncmp(arg, "--filter=", 9)) {
+            options.filter = arg + 9;
+        } else if (!std::strncmp(arg, "--json=", 7)) {
+            options.json = arg + 7;
+        } else if (!std::strncmp(arg, "--input=", 8)) {
+            options.input = arg + 8;
+        } else {
+            printf("usage: %s [--reps=<n>] [--filter=<substring>] [--json=<file>] "
+                   "[--input=<media file>]\n",
+                   argv[0]);
+            return ERROR;
+        }
+    }
+    av_log_set_level(AV_LOG_ERROR);
+
+    print_header();
+    for (auto &res : kResolutions) {
+        EncodedStream stream;
+        if (encode_synthetic(res, &stream) == OK) bench_decode(options, res.name, &stream);
+        release_stream(&stream);
+    }
+    if (options.input) {
+        EncodedStream stream;
+        if (load_file(options.input, &stream) == OK) bench_decode(options, "file", &stream);
+        release_stream(&stream);
+    }
+
+    // the synthetic frames are a function of their index, there is no seed to record
+    if (!options.json.empty()) write_json(options.json, "libav", 0);
+    return OK;
+}
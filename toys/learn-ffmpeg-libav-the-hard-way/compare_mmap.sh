@@ -0,0 +1,16 @@
+#!/bin/bash
+
+# compare the default file protocol against ff_mmap_io when demuxing the sample mp4.
+# `strace -c` gives the syscall summary, 02_remuxing logs the demux throughput.
+
+CUR=$(pwd)
+PRJ=$(dirname $(dirname $CUR))
+VID=$PRJ/media/v # video
+IN=$VID/small_bunny_1080p_60fps.mp4
+OUT=/tmp/remux_out.mp4
+
+for IO in "" "--mmap" "--mmap-buffer=4194304"; do
+    printf "\n==== 02_remuxing %s ====\n" "${IO:-(file protocol)}"
+    strace -c -f -e trace=read,lseek,mmap,munmap,openat ./out/02_remuxing $IO $IN $OUT 2>&1 \
+        | grep -E "demuxed|calls|total|read|lseek|mmap"
+done
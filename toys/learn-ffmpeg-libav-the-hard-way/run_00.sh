@@ -6,4 +6,13 @@ VID=$PRJ/media/v # video
 AUD=$PRJ/media/a # audio
 IMG=$PRJ/media/i # image
 
-./out/00_hello_world $VID/small_bunny_1080p_60fps.mp4 $VID/invalid.url
\ No newline at end of file
+./out/00_hello_world $VID/small_bunny_1080p_60fps.mp4 $VID/invalid.url
+
+# keyframe-only contact sheet
+./out/00_hello_world --thumbnails=16 $VID/small_bunny_1080p_60fps.mp4
+
+# every file of a directory (or a list file) on a worker pool
+./out/00_hello_world --batch=$VID --jobs=4
+
+# per stage latency/bytes, rewritten every second and at exit
+./out/00_hello_world --metrics=metrics.prom --metrics-interval=1000 $VID/small_bunny_1080p_60fps.mp4
@@ -0,0 +1,16 @@
+#!/bin/bash
+
+CUR=$(pwd)
+PRJ=$(dirname $(dirname $CUR))
+VID=$PRJ/media/v # video
+
+IN=$VID/small_bunny_1080p_60fps.mp4
+
+# frame threaded x264 with lookahead: real time factor
+./out/03_transcoding --preset=throughput $IN /tmp/transcode_throughput.mp4
+
+# zerolatency, sliced threads and a single frame in flight: end to end latency per frame
+FF_LOG=info,latency=debug ./out/03_transcoding --preset=latency $IN /tmp/transcode_latency.mp4
+
+# our own kernels in front of the encoder
+./out/03_transcoding --gray --downscale $IN /tmp/transcode_gray_half.mp4
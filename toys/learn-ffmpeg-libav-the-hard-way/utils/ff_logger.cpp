@@ -0,0 +1,386 @@
+#include "ff_logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ff {
+
+namespace {
+
+constexpr size_t kRingSize = 1024;  // records per thread, power of two
+constexpr size_t kMaxModuleName = 16;
+constexpr size_t kMaxMessage = 256;
+constexpr size_t kMaxModuleFilters = 16;
+
+struct Record {
+    int64_t ns;
+    LogLevel level;
+    char module[kMaxModuleName];
+    char text[kMaxMessage];
+};
+
+constexpr size_t kCacheLine = 64;
+
+// single producer (the owning thread), single consumer (the drain thread)
+struct Ring {
+    // separate cache lines, producer and consumer would keep stealing a shared one
+    alignas(kCacheLine) std::atomic<uint64_t> head{0};
+    alignas(kCacheLine) std::atomic<uint64_t> tail{0};
+    std::atomic<bool> retired{false};  // owner exited, freed once drained
+    uint64_t id;  // unique per ring, a later ring may reuse a freed one's address
+    Record records[kRingSize];
+};
+
+// c++14 operator new ignores the over-alignment above
+Ring *new_ring(uint64_t id) {
+    void *memory = nullptr;
+    if (posix_memalign(&memory, kCacheLine, sizeof(Ring)) != 0) throw std::bad_alloc();
+    auto *ring = new (memory) Ring;
+    ring->id = id;
+    return ring;
+}
+
+void delete_ring(Ring *ring) {
+    ring->~Ring();
+    std::free(ring);
+}
+
+struct ModuleFilter {
+    char name[kMaxModuleName];
+    std::atomic<int> level;
+};
+
+std::atomic<int> g_default_level{kLogTrace};
+// lowest level any filter lets through, lets most filtered calls return after one load
+std::atomic<int> g_min_level{kLogTrace};
+ModuleFilter g_filters[kMaxModuleFilters];
+std::atomic<size_t> g_nfilters{0};
+std::mutex g_filters_lock;
+
+std::atomic<std::FILE *> g_output{nullptr};
+const auto g_start = std::chrono::steady_clock::now();
+
+std::mutex g_rings_lock;
+std::vector<Ring *> g_rings;
+uint64_t g_next_ring_id = 0;  // guarded by g_rings_lock
+std::mutex g_wake_lock;
+std::condition_variable g_wake;
+std::atomic<bool> g_wake_pending{false};  // one notify per drain round is enough
+std::thread g_drainer;
+std::atomic<bool> g_running{false};
+std::atomic<bool> g_stopping{false};
+std::atomic<bool> g_initialized{false};
+std::once_flag g_init;
+
+// plain thread_locals, the owner may still log from its own thread_local destructors
+thread_local Ring *t_ring = nullptr;
+thread_local bool t_retired = false;
+
+struct RingOwner {
+    void attach(Ring *ring) { t_ring = ring; }
+    ~RingOwner() {
+        t_retired = true;
+        if (t_ring) t_ring->retired.store(true, std::memory_order_release);
+    }
+};
+thread_local RingOwner t_owner;
+
+const char kLevelChars[] = "TDIWE";
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                g_start)
+        .count();
+}
+
+std::FILE *output() {
+    auto *file = g_output.load(std::memory_order_relaxed);
+    return file ? file : stderr;
+}
+
+// hand rolled "LOG <level> <seconds>.<us> [module] text", snprintf with %f would make the drain
+// thread slower than its producers
+void format_record(const Record &record, std::string *out) {
+    char head[32];
+    auto us = record.ns / 1000;
+    auto *end = head + sizeof(head);
+    auto *p = end;
+    for (auto i = 0; i < 6; ++i, us /= 10) *--p = '0' + us % 10;
+    *--p = '.';
+    do {
+        *--p = '0' + us % 10;
+        us /= 10;
+    } while (us > 0);
+    out->append("LOG ");
+    out->push_back(kLevelChars[record.level]);
+    out->push_back(' ');
+    out->append(p, end - p);
+    out->append(" [");
+    out->append(record.module);
+    out->append("] ");
+    out->append(record.text);
+    out->push_back('\n');
+}
+
+void update_min_level() {
+    auto level = g_default_level.load();
+    for (size_t i = 0; i < g_nfilters.load(); ++i) {
+        level = std::min(level, g_filters[i].level.load());
+    }
+    g_min_level.store(level);
+}
+
+bool parse_level(const std::string &name, LogLevel *level) {
+    const char *names[] = {"trace", "debug", "info", "warn", "error", "off"};
+    for (auto i = 0; i <= kLogOff; ++i) {
+        if (name == names[i]) {
+            *level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// FF_LOG=<level>[,<module>=<level>...]
+void parse_env() {
+    const char *env = std::getenv("FF_LOG");
+    if (!env) return;
+    std::string spec{env};
+    size_t pos = 0;
+    while (pos <= spec.size()) {
+        auto end = std::min(spec.find(',', pos), spec.size());
+        auto item = spec.substr(pos, end - pos);
+        auto eq = item.find('=');
+        LogLevel level;
+        if (item.empty()) {
+            // nothing between two commas
+        } else if (!parse_level(eq == std::string::npos ? item : item.substr(eq + 1), &level)) {
+            // a typo must not silence the logger, the item is skipped. still initializing, so
+            // straight to stderr
+            std::fprintf(stderr, "FF_LOG: ignoring unknown item \"%s\"\n", item.c_str());
+        } else if (eq == std::string::npos) {
+            set_log_level(level);
+        } else {
+            set_log_level(level, item.substr(0, eq).c_str());
+        }
+        pos = end + 1;
+    }
+}
+
+// takes everything published so far from every ring, orders it by timestamp and writes it with a
+// single fwrite. returns the number of records written
+size_t drain() {
+    std::vector<Ring *> rings;
+    {
+        std::lock_guard<std::mutex> lock(g_rings_lock);
+        rings = g_rings;
+    }
+
+    std::vector<uint64_t> heads(rings.size());
+    std::vector<const Record *> records;
+    for (size_t i = 0; i < rings.size(); ++i) {
+        auto tail = rings[i]->tail.load(std::memory_order_relaxed);
+        heads[i] = rings[i]->head.load(std::memory_order_acquire);
+        for (auto seq = tail; seq < heads[i]; ++seq) {
+            records.push_back(&rings[i]->records[seq & (kRingSize - 1)]);
+        }
+    }
+    std::stable_sort(records.begin(), records.end(),
+                     [](const Record *a, const Record *b) { return a->ns < b->ns; });
+
+    if (!records.empty()) {
+        std::string out;
+        out.reserve(records.size() * 96);
+        for (auto *record : records) format_record(*record, &out);
+        std::fwrite(out.data(), 1, out.size(), output());
+        std::fflush(output());
+    }
+
+    std::vector<Ring *> dead;
+    for (size_t i = 0; i < rings.size(); ++i) {
+        // retired is checked before publishing the tail, so nothing can be pushed after it
+        auto retired = rings[i]->retired.load(std::memory_order_acquire);
+        rings[i]->tail.store(heads[i], std::memory_order_release);
+        if (retired && rings[i]->head.load(std::memory_order_acquire) == heads[i]) {
+            dead.push_back(rings[i]);
+        }
+    }
+    if (!dead.empty()) {
+        std::lock_guard<std::mutex> lock(g_rings_lock);
+        for (auto *ring : dead) {
+            g_rings.erase(std::find(g_rings.begin(), g_rings.end(), ring));
+            delete_ring(ring);
+        }
+    }
+    return records.size();
+}
+
+void wake_drainer() {
+    if (!g_wake_pending.exchange(true, std::memory_order_relaxed)) g_wake.notify_one();
+}
+
+void drain_loop() {
+    while (!g_stopping.load()) {
+        g_wake_pending.store(false, std::memory_order_relaxed);
+        if (drain() == 0) {
+            std::unique_lock<std::mutex> lock(g_wake_lock);
+            g_wake.wait_for(lock, std::chrono::milliseconds(1));
+        }
+    }
+    while (drain() > 0) {
+    }
+}
+
+void shutdown() {
+    g_stopping.store(true);
+    g_wake.notify_one();
+    if (g_drainer.joinable()) g_drainer.join();
+    // late messages (static destructors etc.) fall back to synchronous writes
+    g_running.store(false);
+}
+
+void init() {
+    if (g_initialized.load(std::memory_order_acquire)) return;
+    std::call_once(g_init, [] {
+        parse_env();
+        g_running.store(true);
+        g_drainer = std::thread(drain_loop);
+        std::atexit(shutdown);
+        g_initialized.store(true, std::memory_order_release);
+    });
+}
+
+void write_sync(LogLevel level, const char *module, const char *fmt, std::va_list args) {
+    Record record;
+    record.ns = now_ns();
+    record.level = level;
+    std::snprintf(record.module, sizeof(record.module), "%s", module);
+    std::vsnprintf(record.text, sizeof(record.text), fmt, args);
+    std::string out;
+    format_record(record, &out);
+    std::fwrite(out.data(), 1, out.size(), output());
+}
+
+}  // namespace
+
+void set_log_level(LogLevel level, const char *module) {
+    if (!module) {
+        g_default_level.store(level);
+        update_min_level();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_filters_lock);
+    auto n = g_nfilters.load();
+    for (size_t i = 0; i < n; ++i) {
+        if (!std::strncmp(g_filters[i].name, module, kMaxModuleName - 1)) {
+            g_filters[i].level.store(level);
+            update_min_level();
+            return;
+        }
+    }
+    if (n == kMaxModuleFilters) return;
+    std::snprintf(g_filters[n].name, kMaxModuleName, "%s", module);
+    g_filters[n].level.store(level);
+    g_nfilters.store(n + 1);
+    update_min_level();
+}
+
+bool log_enabled(LogLevel level, const char *module) {
+    init();
+    if (level < g_min_level.load(std::memory_order_relaxed)) return false;
+    auto n = g_nfilters.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; ++i) {
+        if (!std::strncmp(g_filters[i].name, module, kMaxModuleName - 1)) {
+            return level >= g_filters[i].level.load(std::memory_order_relaxed);
+        }
+    }
+    return level >= g_default_level.load(std::memory_order_relaxed);
+}
+
+void set_log_output(std::FILE *file) {
+    log_flush();
+    g_output.store(file);
+}
+
+void log_message(LogLevel level, const char *module, const char *fmt, ...) {
+    std::va_list args;
+    va_start(args, fmt);
+    vlog_message(level, module, fmt, args);
+    va_end(args);
+}
+
+void vlog_message(LogLevel level, const char *module, const char *fmt, std::va_list args) {
+    init();
+    if (!g_running.load(std::memory_order_relaxed) || t_retired) {
+        write_sync(level, module, fmt, args);
+        return;
+    }
+
+    if (!t_ring) {
+        // going through t_owner registers its destructor for this thread
+        std::lock_guard<std::mutex> lock(g_rings_lock);
+        t_owner.attach(new_ring(g_next_ring_id++));
+        g_rings.push_back(t_ring);
+    }
+
+    auto head = t_ring->head.load(std::memory_order_relaxed);
+    // full: wait for the drain thread rather than dropping messages
+    while (head - t_ring->tail.load(std::memory_order_acquire) >= kRingSize) {
+        wake_drainer();
+        std::this_thread::yield();
+    }
+
+    auto &record = t_ring->records[head & (kRingSize - 1)];
+    record.ns = now_ns();
+    record.level = level;
+    std::strncpy(record.module, module, kMaxModuleName - 1);
+    record.module[kMaxModuleName - 1] = '\0';
+    std::vsnprintf(record.text, kMaxMessage, fmt, args);
+    t_ring->head.store(head + 1, std::memory_order_release);
+    if (head + 1 - t_ring->tail.load(std::memory_order_relaxed) >= kRingSize / 2) wake_drainer();
+}
+
+void log_flush() {
+    init();
+    if (!g_running.load()) {
+        std::fflush(output());
+        return;
+    }
+
+    struct Pending {
+        Ring *ring;
+        uint64_t id;
+        uint64_t head;
+    };
+    std::vector<Pending> pending;
+    {
+        std::lock_guard<std::mutex> lock(g_rings_lock);
+        for (auto *ring : g_rings) pending.push_back({ring, ring->id, ring->head.load()});
+    }
+    for (auto &item : pending) {
+        // rings only get freed once retired and drained, so a freed ring was already flushed.
+        // the id tells a new ring at the same address apart from it
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(g_rings_lock);
+                auto it = std::find(g_rings.begin(), g_rings.end(), item.ring);
+                if (it == g_rings.end() || (*it)->id != item.id) break;
+                if (item.ring->tail.load() >= item.head) break;
+            }
+            wake_drainer();
+            std::this_thread::yield();
+        }
+    }
+}
+
+}  // namespace ff
@@ -0,0 +1,205 @@
+#include "ff_metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ff {
+
+thread_local StageMetrics *t_stage_metrics = nullptr;
+
+namespace {
+
+const char *kStageNames[kStageCount] = {"demux",       "send_packet", "receive_frame", "write_frame",
+                                        "process_frame", "encode",    "mux"};
+
+// per thread arrays stay registered after their thread exits so totals never go backwards
+std::mutex g_threads_lock;
+std::vector<StageMetrics *> g_threads;
+
+std::mutex g_export_lock;
+std::condition_variable g_export_wake;
+std::thread g_exporter;
+std::string g_export_path;
+bool g_export_stop = false;
+
+double calibrate_ns_per_tick() {
+    auto ns_start = std::chrono::steady_clock::now();
+    auto ticks_start = metric_ticks();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - ns_start;
+    auto ticks = metric_ticks() - ticks_start;
+    return ticks > 0 ? ns.count() / ticks : 1.0;
+}
+
+double ns_per_tick() {
+    static const double value = calibrate_ns_per_tick();
+    return value;
+}
+
+uint64_t bucket_value(int bucket) {
+    if (bucket < (1 << kMetricSubBucketBits)) return bucket;
+    auto exponent = bucket >> kMetricSubBucketBits;
+    auto sub = bucket & ((1 << kMetricSubBucketBits) - 1);
+    return static_cast<uint64_t>((1 << kMetricSubBucketBits) + sub) << (exponent - 1);
+}
+
+struct StageSummary {
+    uint64_t count = 0;
+    uint64_t ticks = 0;
+    uint64_t max_ticks = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t histogram[kMetricBuckets] = {};
+
+    double mean_ns() const { return count ? ticks * ns_per_tick() / count : 0; }
+    double max_ns() const { return max_ticks * ns_per_tick(); }
+    double seconds() const { return ticks * ns_per_tick() / 1e9; }
+    // lower bound of the bucket holding the q-th quantile
+    double quantile_ns(double q) const {
+        if (!count) return 0;
+        auto rank = static_cast<uint64_t>(q * (count - 1)) + 1;
+        uint64_t seen = 0;
+        for (auto bucket = 0; bucket < kMetricBuckets; ++bucket) {
+            seen += histogram[bucket];
+            if (seen >= rank) return bucket_value(bucket) * ns_per_tick();
+        }
+        return max_ns();
+    }
+};
+
+void summarize(StageSummary summaries[kStageCount]) {
+    std::lock_guard<std::mutex> lock(g_threads_lock);
+    for (auto *metrics : g_threads) {
+        for (auto stage = 0; stage < kStageCount; ++stage) {
+            auto &from = metrics[stage];
+            auto &to = summaries[stage];
+            to.count += from.count.load(std::memory_order_relaxed);
+            to.ticks += from.ticks.load(std::memory_order_relaxed);
+            to.max_ticks = std::max(to.max_ticks, from.max_ticks.load(std::memory_order_relaxed));
+            to.bytes_in += from.bytes_in.load(std::memory_order_relaxed);
+            to.bytes_out += from.bytes_out.load(std::memory_order_relaxed);
+            for (auto bucket = 0; bucket < kMetricBuckets; ++bucket) {
+                to.histogram[bucket] += from.histogram[bucket].load(std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void append(std::string *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void append(std::string *out, const char *fmt, ...) {
+    char line[512];
+    std::va_list args;
+    va_start(args, fmt);
+    std::vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    out->append(line);
+}
+
+void write_metrics(const std::string &path) {
+    auto len = path.size();
+    auto prometheus = len > 5 && path.compare(len - 5, 5, ".prom") == 0;
+    auto text = prometheus ? metrics_prometheus() : metrics_json();
+    // write aside and rename, a scraper never sees a half written file
+    auto tmp = path + ".tmp";
+    auto *file = std::fopen(tmp.c_str(), "w");
+    if (!file) return;
+    std::fwrite(text.data(), 1, text.size(), file);
+    std::fclose(file);
+    std::rename(tmp.c_str(), path.c_str());
+}
+
+void stop_export() {
+    {
+        std::lock_guard<std::mutex> lock(g_export_lock);
+        g_export_stop = true;
+    }
+    g_export_wake.notify_one();
+    if (g_exporter.joinable()) g_exporter.join();
+    write_metrics(g_export_path);
+}
+
+}  // namespace
+
+StageMetrics *register_thread_metrics() {
+    t_stage_metrics = new StageMetrics[kStageCount];
+    std::lock_guard<std::mutex> lock(g_threads_lock);
+    g_threads.push_back(t_stage_metrics);
+    return t_stage_metrics;
+}
+
+std::string metrics_json() {
+    StageSummary summaries[kStageCount];
+    summarize(summaries);
+
+    std::string out{"{\n  \"stages\": {\n"};
+    for (auto stage = 0; stage < kStageCount; ++stage) {
+        auto &s = summaries[stage];
+        append(&out,
+               "    \"%s\": {\"count\": %llu, \"total_s\": %.6f, \"mean_ns\": %.1f, "
+               "\"p50_ns\": %.1f, \"p90_ns\": %.1f, \"p99_ns\": %.1f, \"max_ns\": %.1f, "
+               "\"bytes_in\": %llu, \"bytes_out\": %llu}%s\n",
+               kStageNames[stage], static_cast<unsigned long long>(s.count), s.seconds(),
+               s.mean_ns(), s.quantile_ns(0.5), s.quantile_ns(0.9), s.quantile_ns(0.99),
+               s.max_ns(), static_cast<unsigned long long>(s.bytes_in),
+               static_cast<unsigned long long>(s.bytes_out), stage + 1 < kStageCount ? "," : "");
+    }
+    out.append("  }\n}\n");
+    return out;
+}
+
+std::string metrics_prometheus() {
+    StageSummary summaries[kStageCount];
+    summarize(summaries);
+
+    std::string out;
+    out.append("# TYPE ff_stage_latency_seconds summary\n");
+    for (auto stage = 0; stage < kStageCount; ++stage) {
+        auto &s = summaries[stage];
+        for (auto q : {0.5, 0.9, 0.99}) {
+            append(&out, "ff_stage_latency_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                   kStageNames[stage], q, s.quantile_ns(q) / 1e9);
+        }
+        append(&out, "ff_stage_latency_seconds_sum{stage=\"%s\"} %.9f\n", kStageNames[stage],
+               s.seconds());
+        append(&out, "ff_stage_latency_seconds_count{stage=\"%s\"} %llu\n", kStageNames[stage],
+               static_cast<unsigned long long>(s.count));
+    }
+    out.append("# TYPE ff_stage_bytes_in_total counter\n");
+    for (auto stage = 0; stage < kStageCount; ++stage) {
+        append(&out, "ff_stage_bytes_in_total{stage=\"%s\"} %llu\n", kStageNames[stage],
+               static_cast<unsigned long long>(summaries[stage].bytes_in));
+    }
+    out.append("# TYPE ff_stage_bytes_out_total counter\n");
+    for (auto stage = 0; stage < kStageCount; ++stage) {
+        append(&out, "ff_stage_bytes_out_total{stage=\"%s\"} %llu\n", kStageNames[stage],
+               static_cast<unsigned long long>(summaries[stage].bytes_out));
+    }
+    return out;
+}
+
+void metrics_export_at_exit(const char *path, int interval_ms) {
+    if (!g_export_path.empty()) return;
+    g_export_path = path;
+    // calibrate now rather than stalling the first export
+    ns_per_tick();
+    if (interval_ms > 0) {
+        g_exporter = std::thread([interval_ms] {
+            std::unique_lock<std::mutex> lock(g_export_lock);
+            while (!g_export_wake.wait_for(lock, std::chrono::milliseconds(interval_ms),
+                                           [] { return g_export_stop; })) {
+                write_metrics(g_export_path);
+            }
+        });
+    }
+    std::atexit(stop_export);
+}
+
+}  // namespace ff
@@ -0,0 +1,136 @@
+#include "ff_mmap_io.h"
+#include "ff_logging.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+namespace ff {
+
+namespace {
+
+struct MmapSource {
+    const uint8_t *data;
+    int64_t size;
+    int64_t pos;
+};
+
+int mmap_read_packet(void *opaque, uint8_t *buf, int buf_size) {
+    auto *src = static_cast<MmapSource *>(opaque);
+    auto left = src->size - src->pos;
+    if (left <= 0) return AVERROR_EOF;
+
+    // the only copy left: mapped page cache -> AVIOContext buffer, no read() syscall
+    auto len = static_cast<int>(std::min<int64_t>(left, buf_size));
+    std::memcpy(buf, src->data + src->pos, len);
+    src->pos += len;
+    return len;
+}
+
+int64_t mmap_seek(void *opaque, int64_t offset, int whence) {
+    auto *src = static_cast<MmapSource *>(opaque);
+    if (whence & AVSEEK_SIZE) return src->size;
+
+    int64_t pos;
+    switch (whence & ~AVSEEK_FORCE) {
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = src->pos + offset;
+            break;
+        case SEEK_END:
+            pos = src->size + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if (pos < 0 || pos > src->size) return AVERROR(EINVAL);
+    src->pos = pos;
+    return pos;
+}
+
+void release_source(MmapSource *src) {
+    if (!src) return;
+    munmap(const_cast<uint8_t *>(src->data), src->size);
+    delete src;
+}
+
+void release_io_context(AVIOContext **pb) {
+    if (!*pb) return;
+    release_source(static_cast<MmapSource *>((*pb)->opaque));
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+}
+
+}  // namespace
+
+int mmap_open_input(AVFormatContext **ctx, const char *filename, int buffer_size) {
+    auto fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        auto err = AVERROR(errno);
+        LOGE("ff", "failed to open %s for mmap (%s)", filename, av_err2str(err));
+        return err;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+        LOGE("ff", "%s is empty or not a regular file", filename);
+        close(fd);
+        return AVERROR_INVALIDDATA;
+    }
+    auto *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (addr == MAP_FAILED) {
+        auto err = AVERROR(errno);
+        LOGE("ff", "failed to mmap %s (%s)", filename, av_err2str(err));
+        return err;
+    }
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    auto *src = new MmapSource{static_cast<const uint8_t *>(addr), st.st_size, 0};
+    auto *buffer = static_cast<uint8_t *>(av_malloc(buffer_size));
+    if (!buffer) {
+        LOGE("ff", "failed to allocate %d bytes avio buffer", buffer_size);
+        release_source(src);
+        return AVERROR(ENOMEM);
+    }
+    // libavformat owns (and may reallocate) `buffer`, so the mapping can't be handed over directly
+    auto *pb = avio_alloc_context(buffer, buffer_size, 0, src, mmap_read_packet, NULL, mmap_seek);
+    if (!pb) {
+        LOGE("ff", "failed to allocate avio context");
+        av_free(buffer);
+        release_source(src);
+        return AVERROR(ENOMEM);
+    }
+
+    if (!*ctx && !(*ctx = avformat_alloc_context())) {
+        LOGE("ff", "failed to allocate memory for format context");
+        release_io_context(&pb);
+        return AVERROR(ENOMEM);
+    }
+    (*ctx)->pb = pb;
+    (*ctx)->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    // frees *ctx on failure, but never a custom pb
+    auto ret = avformat_open_input(ctx, filename, NULL, NULL);
+    if (ret < 0) release_io_context(&pb);
+    return ret;
+}
+
+void mmap_close_input(AVFormatContext **ctx) {
+    if (!*ctx) return;
+    // only our own AVIOContext is released here, avformat_close_input closes a protocol one
+    auto *pb = (*ctx)->pb;
+    auto ours = ((*ctx)->flags & AVFMT_FLAG_CUSTOM_IO) && pb && pb->read_packet == mmap_read_packet;
+    avformat_close_input(ctx);
+    if (ours) release_io_context(&pb);
+}
+
+}  // namespace ff
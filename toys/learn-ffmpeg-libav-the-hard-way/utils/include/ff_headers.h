@@ -6,6 +6,7 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libavutil/opt.h>
 #include <libavutil/timestamp.h>
+#include <libswscale/swscale.h>
 }
 
 #endif  // __FF_HEADERS_H__
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef __FF_LOGGER_H__
+#define __FF_LOGGER_H__
+
+#include <cstdarg>
+#include <cstdio>
+
+// call sites below this level are compiled out, set with -DFF_LOG_MIN_LEVEL=<0..5>
+#ifndef FF_LOG_MIN_LEVEL
+#define FF_LOG_MIN_LEVEL 0
+#endif
+
+namespace ff {
+
+enum LogLevel : int {
+    kLogTrace = 0,
+    kLogDebug,
+    kLogInfo,
+    kLogWarn,
+    kLogError,
+    kLogOff,
+};
+
+// runtime filters: `module` NULL sets the default level, otherwise the level of that module only.
+// also read from the FF_LOG env on first use, eg. FF_LOG=info,decode=trace,demux=off. items with
+// an unknown level are reported and skipped
+void set_log_level(LogLevel level, const char *module = nullptr);
+bool log_enabled(LogLevel level, const char *module);
+// where the background thread writes to, stderr by default
+void set_log_output(std::FILE *file);
+
+// formats into the calling thread's ring buffer, a background thread timestamps-orders and writes
+// them out. prefer the LOGx macros, they skip argument evaluation for filtered messages
+void log_message(LogLevel level, const char *module, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+void vlog_message(LogLevel level, const char *module, const char *fmt, std::va_list args);
+// blocks until everything logged so far has been written
+void log_flush();
+
+}  // namespace ff
+
+#define FF_LOG(level, module, ...)                                                \
+    do {                                                                          \
+        if ((level) >= FF_LOG_MIN_LEVEL && ff::log_enabled((level), (module))) { \
+            ff::log_message((level), (module), __VA_ARGS__);                      \
+        }                                                                         \
+    } while (0)
+
+#define LOGT(module, ...) FF_LOG(ff::kLogTrace, module, __VA_ARGS__)
+#define LOGD(module, ...) FF_LOG(ff::kLogDebug, module, __VA_ARGS__)
+#define LOGI(module, ...) FF_LOG(ff::kLogInfo, module, __VA_ARGS__)
+#define LOGW(module, ...) FF_LOG(ff::kLogWarn, module, __VA_ARGS__)
+#define LOGE(module, ...) FF_LOG(ff::kLogError, module, __VA_ARGS__)
+
+#endif  // __FF_LOGGER_H__
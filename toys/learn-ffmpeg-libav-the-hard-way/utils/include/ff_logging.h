@@ -2,6 +2,7 @@
 #define __FF_LOGGING_H__
 
 #include "ff_headers.h"
+#include "ff_logger.h"
 
 #include <cstdarg>
 #include <cstdint>
@@ -10,8 +11,11 @@
 
 namespace ff {
 
+// info level message of the "ff" module, errors and warnings go through LOGE/LOGW("ff", ...)
 void logging(const char *fmt, ...);
+// trace level, "packet" module
 void log_packet(const AVFormatContext *fmt_ctx, const AVPacket *pkt);
+// debug level, "timing" module
 void print_timing(char *name, AVFormatContext *avf, AVCodecContext *avc, AVStream *avs);
 
 }  // namespace ff
@@ -0,0 +1,151 @@
+#ifndef __FF_METRICS_H__
+#define __FF_METRICS_H__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// 0 compiles every FF_METRIC_* call site out, set with -DFF_METRICS=0
+#ifndef FF_METRICS
+#define FF_METRICS 1
+#endif
+
+namespace ff {
+
+// pipeline stages of the tools, in the order a packet goes through them
+enum MetricStage : int {
+    kStageDemux = 0,     // av_read_frame
+    kStageSendPacket,    // avcodec_send_packet
+    kStageReceiveFrame,  // avcodec_receive_frame
+    kStageWriteFrame,    // dumping decoded frames to disk
+    kStageProcessFrame,  // our own per frame kernels (gray, downscale) before encoding
+    kStageEncode,        // avcodec_send_frame + its avcodec_receive_packet calls, once per frame
+    kStageMux,           // av_interleaved_write_frame
+    kStageCount,
+};
+
+// log-linear (HDR style) latency buckets: 8 sub-buckets per power of two of ticks, so every
+// bucket is within 12.5% of its value
+constexpr int kMetricSubBucketBits = 3;
+constexpr int kMetricBuckets = 64 << kMetricSubBucketBits;
+
+// one per thread and stage. a single thread writes it, so plain load + store updates are enough
+// and exporters read them relaxed
+struct StageMetrics {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> ticks{0};
+    std::atomic<uint64_t> max_ticks{0};
+    std::atomic<uint64_t> bytes_in{0};
+    std::atomic<uint64_t> bytes_out{0};
+    std::atomic<uint64_t> histogram[kMetricBuckets] = {};
+};
+
+// monotonic tick source: the TSC where available (assumed invariant), calibrated against
+// steady_clock once
+inline uint64_t metric_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+// calling thread's kStageCount metrics, registered on first use
+StageMetrics *register_thread_metrics();
+extern thread_local StageMetrics *t_stage_metrics;
+inline StageMetrics *thread_stage_metrics() {
+    auto *metrics = t_stage_metrics;
+    return metrics ? metrics : register_thread_metrics();
+}
+
+inline void metric_add(std::atomic<uint64_t> *counter, uint64_t n) {
+    counter->store(counter->load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline int metric_bucket(uint64_t ticks) {
+    if (ticks < (1u << kMetricSubBucketBits)) return static_cast<int>(ticks);
+    auto msb = 63 - __builtin_clzll(ticks);
+    auto sub = (ticks >> (msb - kMetricSubBucketBits)) & ((1u << kMetricSubBucketBits) - 1);
+    return ((msb - kMetricSubBucketBits + 1) << kMetricSubBucketBits) + static_cast<int>(sub);
+}
+
+inline void record_latency(MetricStage stage, uint64_t ticks) {
+    auto &metrics = thread_stage_metrics()[stage];
+    metric_add(&metrics.count, 1);
+    metric_add(&metrics.ticks, ticks);
+    metric_add(&metrics.histogram[metric_bucket(ticks)], 1);
+    if (ticks > metrics.max_ticks.load(std::memory_order_relaxed)) {
+        metrics.max_ticks.store(ticks, std::memory_order_relaxed);
+    }
+}
+
+inline void record_bytes(MetricStage stage, uint64_t in, uint64_t out) {
+    auto &metrics = thread_stage_metrics()[stage];
+    metric_add(&metrics.bytes_in, in);
+    metric_add(&metrics.bytes_out, out);
+}
+
+class ScopedStageTimer {
+   public:
+    explicit ScopedStageTimer(MetricStage stage) : stage_(stage), start_(metric_ticks()) {}
+    ~ScopedStageTimer() { record_latency(stage_, metric_ticks() - start_); }
+
+   private:
+    MetricStage stage_;
+    uint64_t start_;
+};
+
+// adds the scope's ticks to `*total`, for a stage spread over several calls that is recorded
+// once with FF_METRIC_RECORD
+class ScopedTickCounter {
+   public:
+    explicit ScopedTickCounter(uint64_t *total) : total_(total), start_(metric_ticks()) {}
+    ~ScopedTickCounter() { *total_ += metric_ticks() - start_; }
+
+   private:
+    uint64_t *total_;
+    uint64_t start_;
+};
+
+// aggregated over all threads so far
+std::string metrics_json();
+std::string metrics_prometheus();
+// writes to `path`, prometheus text format if it ends with .prom, json otherwise. with
+// `interval_ms` > 0 it is also rewritten periodically from a background thread
+void metrics_export_at_exit(const char *path, int interval_ms = 0);
+
+}  // namespace ff
+
+#if FF_METRICS
+#define FF_METRIC_CONCAT_(a, b) a##b
+#define FF_METRIC_CONCAT(a, b) FF_METRIC_CONCAT_(a, b)
+#define FF_METRIC_TIMER(stage) \
+    ff::ScopedStageTimer FF_METRIC_CONCAT(ff_metric_timer_, __LINE__)(stage)
+#define FF_METRIC_TICKS(total) \
+    ff::ScopedTickCounter FF_METRIC_CONCAT(ff_metric_ticks_, __LINE__)(total)
+#define FF_METRIC_RECORD(stage, ticks) ff::record_latency((stage), (ticks))
+#define FF_METRIC_BYTES(stage, in, out) ff::record_bytes((stage), (in), (out))
+#else
+#define FF_METRIC_TIMER(stage) \
+    do {                       \
+    } while (0)
+#define FF_METRIC_TICKS(total) \
+    do {                       \
+    } while (0)
+#define FF_METRIC_RECORD(stage, ticks) \
+    do {                               \
+    } while (0)
+#define FF_METRIC_BYTES(stage, in, out) \
+    do {                                \
+    } while (0)
+#endif
+
+#endif  // __FF_METRICS_H__
@@ -0,0 +1,22 @@
+#ifndef __FF_MMAP_IO_H__
+#define __FF_MMAP_IO_H__
+
+#include "ff_headers.h"
+
+namespace ff {
+
+// size of the AVIOContext buffer libavformat parses from. the default file protocol only uses
+// 32KB, a larger one means fewer read callbacks per demuxed packet
+constexpr int kDefaultMmapIOBufferSize = 1 << 20;
+
+// same as avformat_open_input, but the input is read through a custom AVIOContext backed by an
+// mmap of the whole local file instead of the file protocol. `*ctx` may be preallocated or NULL.
+int mmap_open_input(AVFormatContext **ctx, const char *filename,
+                    int buffer_size = kDefaultMmapIOBufferSize);
+// same as avformat_close_input, also releases the AVIOContext and the mapping when `*ctx` was
+// opened by mmap_open_input. safe to call on any input, whichever way it was opened
+void mmap_close_input(AVFormatContext **ctx);
+
+}  // namespace ff
+
+#endif  // __FF_MMAP_IO_H__
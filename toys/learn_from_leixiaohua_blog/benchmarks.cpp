@@ -0,0 +1,261 @@
+#include "image_proc.hpp"
+#include "simple_h264_stream_parser.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+// deterministic synthetic inputs, same bytes on every run and every commit
+constexpr uint32_t kSeed = 20210408;
+constexpr double kWarmupSeconds = 0.1;
+constexpr int kMinWarmupIters = 3;
+constexpr double kTargetRepSeconds = 0.1;
+
+struct Resolution {
+    const char *name;
+    uint32_t width;
+    uint32_t height;
+};
+
+constexpr Resolution kResolutions[] = {
+    {"qcif", 176, 144}, {"cif", 352, 288}, {"720p", 1280, 720}, {"1080p", 1920, 1080},
+    {"4k", 3840, 2160},
+};
+
+struct Options {
+    int reps = 5;
+    std::string filter;
+    std::string json;
+};
+
+// the harness below is kept identical in both projects' benchmarks.cpp: same warm-up policy, same
+// table and the same json schema, so results of the two drivers compare directly
+
+struct Result {
+    std::string name;
+    std::string input;
+    uint64_t bytes;  // processed per iteration
+    int items;       // frames or NAL units per iteration
+    int iters;       // per repetition
+    std::vector<double> ns;  // per iteration, one sample per repetition
+    double min, median, mean, stddev;
+};
+
+std::vector<Result> results;
+
+void summarize(Result *result) {
+    auto sorted = result->ns;
+    std::sort(sorted.begin(), sorted.end());
+    auto n = sorted.size();
+    result->min = sorted.front();
+    result->median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    double sum = 0, sq = 0;
+    for (auto v : sorted) sum += v;
+    result->mean = sum / n;
+    for (auto v : sorted) sq += (v - result->mean) * (v - result->mean);
+    result->stddev = n > 1 ? std::sqrt(sq / (n - 1)) : 0;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void print_header() {
+    std::printf("%-22s %-14s %12s %12s %9s %10s %12s\n", "benchmark", "input", "median(us)",
+                "min(us)", "stddev", "MB/s", "items/s");
+}
+
+// warms `body` up for kWarmupSeconds (and at least kMinWarmupIters), sizes a repetition to
+// ~kTargetRepSeconds, then times `reps` repetitions
+void run(const Options &options, const std::string &name, const std::string &input,
+         uint64_t bytes, int items, const std::function<void()> &body) {
+    if (!options.filter.empty() && (name + "/" + input).find(options.filter) == std::string::npos) {
+        return;
+    }
+
+    int warmup_iters = 0;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        body();
+        ++warmup_iters;
+    } while (seconds_since(start) < kWarmupSeconds || warmup_iters < kMinWarmupIters);
+    auto per_iter = seconds_since(start) / warmup_iters;
+    auto iters = std::max(1, static_cast<int>(kTargetRepSeconds / per_iter));
+
+    Result result{name, input, bytes, items, iters, {}, 0, 0, 0, 0};
+    for (auto rep = 0; rep < options.reps; ++rep) {
+        start = std::chrono::steady_clock::now();
+        for (auto i = 0; i < iters; ++i) body();
+        result.ns.push_back(seconds_since(start) * 1e9 / iters);
+    }
+    summarize(&result);
+    std::printf("%-22s %-14s %12.1f %12.1f %8.2f%% %10.1f %12.1f\n", name.c_str(), input.c_str(),
+                result.median / 1e3, result.min / 1e3, result.stddev / result.mean * 100,
+                bytes / (result.median / 1e9) / (1 << 20), items / (result.median / 1e9));
+    results.push_back(result);
+}
+
+void write_json(const std::string &path, const char *suite, uint32_t seed) {
+    auto *file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::fprintf(stderr, "failed to open %s\n", path.c_str());
+        return;
+    }
+    std::fprintf(file, "{\n  \"suite\": \"%s\",\n  \"seed\": %u,\n  \"benchmarks\": [\n", suite,
+                 seed);
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto &r = results[i];
+        std::fprintf(file,
+                     "    {\"name\": \"%s\", \"input\": \"%s\", \"bytes\": %llu, \"items\": %d, "
+                     "\"iters\": %d, \"reps\": %zu, \"ns_min\": %.1f, \"ns_median\": %.1f, "
+                     "\"ns_mean\": %.1f, \"ns_stddev\": %.1f, \"mb_per_s\": %.2f, "
+                     "\"items_per_s\": %.2f}%s\n",
+                     r.name.c_str(), r.input.c_str(), static_cast<unsigned long long>(r.bytes),
+                     r.items, r.iters, r.ns.size(), r.min, r.median, r.mean, r.stddev,
+                     r.bytes / (r.median / 1e9) / (1 << 20), r.items / (r.median / 1e9),
+                     i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+    std::fclose(file);
+}
+
+std::vector<char> random_bytes(std::mt19937 *rng, size_t size) {
+    std::vector<char> bytes(size);
+    for (auto &byte : bytes) byte = static_cast<char>((*rng)() & 0xff);
+    return bytes;
+}
+
+// appends a NAL unit with a random payload, escaped with emulation prevention bytes so the only
+// start codes in the stream are the real ones
+void append_nalu(std::mt19937 *rng, std::vector<char> *stream, uint8_t header, size_t size,
+                 bool long_startcode) {
+    if (long_startcode) stream->push_back(0);
+    stream->insert(stream->end(), {0, 0, 1, static_cast<char>(header)});
+    int zeros = 0;
+    for (size_t i = 0; i < size; ++i) {
+        auto byte = static_cast<uint8_t>((*rng)() & 0xff);
+        if (zeros >= 2 && byte <= 3) {
+            stream->push_back(3);
+            zeros = 0;
+        }
+        stream->push_back(static_cast<char>(byte));
+        zeros = byte == 0 ? zeros + 1 : 0;
+    }
+    // rbsp trailing bits, never a zero byte in front of the next start code
+    stream->push_back(static_cast<char>(0x80));
+}
+
+// SPS, PPS, then GOPs of one IDR and `gop - 1` P slices with random sizes
+std::vector<char> synthetic_annexb(std::mt19937 *rng, size_t target_size, int gop, size_t *nalus) {
+    std::vector<char> stream;
+    *nalus = 0;
+    append_nalu(rng, &stream, 0x67, 24, true);
+    append_nalu(rng, &stream, 0x68, 4, true);
+    *nalus += 2;
+    while (stream.size() < target_size) {
+        append_nalu(rng, &stream, 0x65, 16000 + (*rng)() % 16000, true);
+        ++*nalus;
+        for (auto i = 1; i < gop && stream.size() < target_size; ++i) {
+            append_nalu(rng, &stream, 0x41, 500 + (*rng)() % 8000, false);
+            ++*nalus;
+        }
+    }
+    return stream;
+}
+
+void bench_image(const Options &options, std::mt19937 *rng) {
+    for (auto &res : kResolutions) {
+        auto pixels = res.width * res.height;
+        auto rgb = random_bytes(rng, pixels * 3);
+        std::vector<char> r(pixels), g(pixels), b(pixels);
+        run(options, "deinterleave_rgb888", res.name, rgb.size(), 1,
+            [&] { vid::deinterleave_rgb888(rgb.data(), r.data(), g.data(), b.data(), pixels); });
+
+        auto yuv = random_bytes(rng, pixels * 3 / 2);
+        // only the chroma planes are touched
+        run(options, "gray_420p_frame", res.name, pixels / 2, 1,
+            [&] { vid::gray_420p_frame(yuv.data(), res.width, res.height); });
+
+        // scaling is in place, every iteration starts over from the seeded luma like
+        // reduce_420p_y does per frame, otherwise it would be timing a plane of zeros. the copy
+        // alone is timed as well, scale_420p_y's own cost is the difference of the two
+        std::vector<char> luma(pixels);
+        run(options, "copy_420p_y", res.name, pixels, 1,
+            [&] { std::memcpy(luma.data(), yuv.data(), pixels); });
+        run(options, "scale_420p_y+copy", res.name, pixels, 1, [&] {
+            std::memcpy(luma.data(), yuv.data(), pixels);
+            vid::scale_420p_y(luma.data(), res.width, res.height, 0.5);
+        });
+    }
+}
+
+void bench_h264(const Options &options, std::mt19937 *rng) {
+    char path[] = "/tmp/annexb_XXXXXX";
+    auto fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    struct {
+        const char *name;
+        size_t size;
+    } inputs[] = {{"1MB", 1 << 20}, {"8MB", 8 << 20}};
+    for (auto &input : inputs) {
+        size_t expected = 0;
+        auto stream = synthetic_annexb(rng, input.size, 30, &expected);
+        std::ofstream out(path, std::ios::binary);
+        out.write(stream.data(), stream.size());
+        out.close();
+
+        // the scanning loop of parse_h264, minus the table printing
+        auto nalus = static_cast<int>(expected);
+        run(options, "get_annexb_nalu", input.name, stream.size(), nalus, [&] {
+            std::ifstream file(path, std::ios::binary);
+            vid::Nalu_t nalu;
+            nalu.max_size = vid::MAX_BUF_SIZE;
+            nalu.buf = new char[nalu.max_size];
+            size_t found = 0;
+            while (!file.eof()) {
+                vid::get_annexb_nalu(&file, &nalu);
+                ++found;
+            }
+            delete[] nalu.buf;
+            assert(found == expected);
+        });
+    }
+    unlink(path);
+}
+
+// benchmarks [--reps=<n>] [--filter=<substring>] [--json=<file>]
+int main(int argc, const char *argv[]) {
+    Options options;
+    for (auto i = 1; i < argc; ++i) {
+        std::string arg{argv[i]};
+        if (arg.rfind("--reps=", 0) == 0) {
+            options.reps = std::max(1, std::atoi(arg.c_str() + 7));
+        } else if (arg.rfind("--filter=", 0) == 0) {
+            options.filter = arg.substr(9);
+        } else if (arg.rfind("--json=", 0) == 0) {
+            options.json = arg.substr(7);
+        } else {
+            std::cout << "usage: " << argv[0] << " [--reps=<n>] [--filter=<substring>] "
+                      << "[--json=<file>]" << std::endl;
+            return -1;
+        }
+    }
+
+    print_header();
+    std::mt19937 rng{kSeed};
+    bench_image(options, &rng);
+    bench_h264(options, &rng);
+
+    if (!options.json.empty()) write_json(options.json, "leixiaohua", kSeed);
+}
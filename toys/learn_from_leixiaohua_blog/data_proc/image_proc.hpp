@@ -7,6 +7,7 @@
 #include <iostream>
 #include <cassert>
 #include <cstring>
+#include <vector>
 
 namespace vid {
 
@@ -24,6 +25,28 @@ struct ImageInfo {
     ColorFormat colorFormat;
 };
 
+// splits one packed RGB888 frame into its R, G and B planes
+void deinterleave_rgb888(const char *frame, char *r, char *g, char *b, uint32_t pixels) {
+    for (uint32_t i = 0; i < pixels; ++i) {
+        r[i] = frame[i * 3];
+        g[i] = frame[i * 3 + 1];
+        b[i] = frame[i * 3 + 2];
+    }
+}
+
+// YUV 变灰度只需要保留亮度分量Y，对UV色度分量设128（0）
+void gray_420p_frame(char *frame, uint32_t width, uint32_t height) {
+    auto img_size = width * height;
+    std::memset(frame + img_size, 128, img_size / 2);
+}
+
+void scale_420p_y(char *frame, uint32_t width, uint32_t height, float ratio) {
+    auto img_size = width * height;
+    for (uint32_t pix = 0; pix < img_size; ++pix) {
+        frame[pix] = static_cast<char>(frame[pix] * ratio);
+    }
+}
+
 void extract_yuv420p(std::ifstream *input, uint32_t width, uint32_t height, uint32_t nframes) {
     std::ofstream yout{"yuv_420p.y", std::ios::binary};
     assert(yout.is_open());
@@ -35,7 +58,8 @@ void extract_yuv420p(std::ifstream *input, uint32_t width, uint32_t height, uint
     auto frame_size = width * height * 3 / 2;
     auto y_size = width * height;
     auto uv_size = y_size / 4;
-    char data[frame_size];
+    std::vector<char> buffer(frame_size);
+    auto *data = buffer.data();
     input->seekg(0);
     std::memset(data, 0, frame_size);
     for (auto frame = 0; frame < nframes; ++frame) {
@@ -62,7 +86,8 @@ void extract_yuv444p(std::ifstream *input, uint32_t width, uint32_t height, uint
 
     auto frame_size = width * height * 3;
     auto plane_size = width * height;
-    char data[frame_size];
+    std::vector<char> buffer(frame_size);
+    auto *data = buffer.data();
     input->seekg(0);
     std::memset(data, 0, frame_size);
     for (auto frame = 0; frame < nframes; ++frame) {
@@ -88,18 +113,19 @@ void extract_rgb888(std::ifstream *input, uint32_t width, uint32_t height, uint3
     assert(bout.is_open());
 
     auto frame_size = width * height * 3;
-    char data[frame_size];
+    std::vector<char> buffer(frame_size);
+    auto *data = buffer.data();
+    std::vector<char> r(width * height), g(width * height), b(width * height);
     input->seekg(0);
     std::memset(data, 0, frame_size);
     for (auto frame = 0; frame < nframes; ++frame) {
         input->read(data, frame_size);
         input->seekg(frame_size, std::ios::cur);
 
-        for (auto i = 0; i < frame_size; i += 3) {
-            rout.write(data + i, 1);
-            gout.write(data + i + 1, 1);
-            bout.write(data + i + 2, 1);
-        }
+        deinterleave_rgb888(data, r.data(), g.data(), b.data(), width * height);
+        rout.write(r.data(), r.size());
+        gout.write(g.data(), g.size());
+        bout.write(b.data(), b.size());
     }
 
     rout.close();
@@ -143,15 +169,14 @@ void convert_420p_to_gray(const ImageInfo &info) {
     assert(output.is_open());
 
     auto frame_size = info.width * info.height * 3 / 2;
-    auto img_size = info.width * info.height;
-    char data[frame_size];
+    std::vector<char> buffer(frame_size);
+    auto *data = buffer.data();
     input.seekg(0);
     for (auto frame = 0; frame < info.frames; ++frame) {
         input.read(data, frame_size);
         input.seekg(frame_size, std::ios::cur);
 
-        // YUV 变灰度只需要保留亮度分量Y，对UV色度分量设128（0）
-        std::memset(data + img_size, 128, img_size / 2);
+        gray_420p_frame(data, info.width, info.height);
         output.write(data, frame_size);
     }
 
@@ -168,16 +193,14 @@ void reduce_420p_y(const ImageInfo &info, float ratio) {
     assert(output.is_open());
 
     auto frame_size = info.width * info.height * 3 / 2;
-    auto img_size = info.width * info.height;
-    char data[frame_size];
+    std::vector<char> buffer(frame_size);
+    auto *data = buffer.data();
     input.seekg(0);
     for (auto frame = 0; frame < info.frames; ++frame) {
         input.read(data, frame_size);
         input.seekg(frame_size, std::ios::cur);
 
-        for (auto pix = 0; pix < img_size; ++pix) {
-            data[pix] = static_cast<char>(data[pix] * ratio);
-        }
+        scale_420p_y(data, info.width, info.height, ratio);
 
         output.write(data, frame_size);
     }